@@ -6,13 +6,20 @@ Created on Sun Nov 30 18:19:59 2025
 """
 
 from compute_harness import GLSLComputeHarness, ShaderConfig, BufferSpec, UniformSpec
+from score_histogram import ScoreHistogram
 import numpy as np
 import struct
 import random
 import json
 import time
 
-harness = GLSLComputeHarness()
+try:
+    harness = GLSLComputeHarness()
+except RuntimeError as e:
+    # No GPU: the host-side paths (cpu_explorer, host_variation, model_batch)
+    # still work, anything that dispatches will fail
+    print(f"\033[1;33mWarning: {e}; GPU programs unavailable\033[m")
+    harness = None
 
 class Model(dict):
     
@@ -41,11 +48,34 @@ class Model(dict):
         # Total: 888 bytes
     ])
     
+    # Mirrors AnnealState in explore_variations.glsl.c
+    _anneal_state_dtype = np.dtype([
+        ('template_score', np.float64),         # offset 0
+        ('initialized', np.uint32),             # offset 8
+        ('workgroups_done', np.uint32),         # offset 12
+        ('generation', np.uint32),              # offset 16
+        ('_pad1', np.uint32),                   # offset 20
+        ('layer_temperature', np.float64, (20,)),   # offset 24
+        ('template_layer_err', np.float64, (20,)),  # offset 184
+        ('improved', np.uint32, (20,)),         # offset 344
+        ('evaluated', np.uint32),               # offset 424
+        ('_pad2', np.uint32),                   # offset 428
+        # Total: 432 bytes
+    ])
+    
+    # Mirrors ScoreIndex in explore_variations.glsl.c (SCORE_INDEX)
+    _score_index_dtype = np.dtype([
+        ('score', np.float64),   # offset 0
+        ('idx', np.uint32),      # offset 8
+        ('_pad', np.uint32),     # offset 12
+        # Total: 16 bytes
+    ])
+    
     def __init__(self, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self._recalculate()
         
-        self._shader_initialized = False
+        self._histogram = None
         
     def _recalculate(self):
         for layer in self['layers']:
@@ -235,7 +265,43 @@ class Model(dict):
                 print("        ^ virial_ratio")
         print("=" * 70)
     
-    def explore_variations(self, num_variants, temperature, top_k=None, seed=None):
+    @staticmethod
+    def _explorer_program(num_layers=None, constants=(), instance=0, **defines):
+        """
+        The explorer program for a set of feature defines, with `constants`
+        (UniformSpecs) folded in and, unless num_layers is None,
+        specialized for that layer count. Each variant is compiled once and
+        shared by all models (per `instance`; see
+        GLSLComputeHarness.get_program).
+        """
+        config = ShaderConfig.precision_config("double", "double")
+        if num_layers is not None:
+            config.defines["FIXED_NUM_LAYERS"] = f"{num_layers}u"
+        config.defines.update(defines)
+        return harness.get_program("shader/explore_variations.glsl.c", config.fold(*constants),
+                                   instance)
+    
+    @staticmethod
+    def _dispatch_constants(temperature, error_threshold):
+        """
+        The scoring mode and zero-temperature evaluation are fixed for a
+        dispatch; fold them in so the dead branches disappear.
+        """
+        constants = []
+        if error_threshold == 0.0:
+            constants.append(UniformSpec("error_threshold", 0.0, "1d"))
+        if temperature == 0.0:
+            constants.append(UniformSpec("annealing_temperature", 0.0, "1d"))
+        return constants
+    
+    def _get_program(self, constants=(), instance=0, **defines):
+        """_explorer_program for this model's layer count."""
+        return Model._explorer_program(len(self['layers']), constants, instance, **defines)
+    
+    def explore_variations(self, num_variants, temperature, top_k=None, seed=None,
+                           error_threshold=0.0, max_hits=65536,
+                           return_histogram=False, auto_hit_fraction=1e-3,
+                           distinct_distance=None, distinct_pool=16, regenerate=False):
         """
         Generate variations of the model and return the best ones.
         
@@ -244,20 +310,58 @@ class Model(dict):
             temperature: Annealing temperature for variation size
             top_k: Number of best results to return (default: 1)
             seed: Random seed (default: random)
+            error_threshold: If nonzero, score by kinetic energy among variations
+                whose equipotential error is below this value. Only those hits
+                are copied back from the GPU. "auto" picks the threshold from
+                the error histogram of the previous call on this model (error
+                alone is scored on the first call).
+            max_hits: Capacity of the on-GPU hit buffer when error_threshold is set
+            return_histogram: Also return a ScoreHistogram of all N variations
+            auto_hit_fraction: Fraction of variations an "auto" threshold
+                should let through
+            distinct_distance: If set, top_models are canonicalized and
+                de-duplicated on the GPU (clustering.distinct_records): at
+                most one per basin of this size in log-axis units, drawn
+                from the best top_k * distinct_pool variations
+            distinct_pool: See distinct_distance
+            regenerate: Read back only (score, index) pairs, 16 bytes per
+                variation, and rebuild the winners on the host
+                (host_variation.regenerate_records). Ignored with
+                error_threshold, whose hit buffer is already small.
         
         Returns:
             best_model: The single best Model found
-            top_models: List of top_k Model instances (if top_k > 1)
+            top_models: List of top_k Model instances (if top_k > 1; empty
+                when error_threshold is set and no variation beats it)
+            histogram: ScoreHistogram (only if return_histogram)
         """
         if top_k is None:
             top_k = 1
-            
-        if not self._shader_initialized:
-            config = ShaderConfig.precision_config("double", "double")
-            self.program = harness.create_program("shader/explore_variations.glsl.c", config)
-            self._shader_initialized = True
+        
+        auto_threshold = error_threshold == "auto"
+        if auto_threshold:
+            if self._histogram is None:
+                error_threshold = 0.0
+            else:
+                error_threshold = self._histogram.suggest_error_threshold(auto_hit_fraction)
+                print(f"Auto error threshold: {error_threshold:.3e}")
+        
+        compact = error_threshold != 0.0
+        histogram = return_histogram or auto_threshold
+        regenerate = regenerate and not compact
+        
+        defines = {}
+        if compact:
+            defines['COMPACT_HITS'] = 1
+        if regenerate:
+            defines['SCORE_INDEX'] = 1
+        if histogram:
+            defines.update(ScoreHistogram.defines())
+        
+        constants = Model._dispatch_constants(temperature, error_threshold)
+        self.program = self._get_program(constants, **defines)
     
-            #self.program._dump_source()
+        #self.program._dump_source()
     
         if seed is None:
             seed = random.randint(0, 0xFFFFFFFF)
@@ -281,60 +385,420 @@ class Model(dict):
                 binding=1,
                 dtype=Model._model_dtype,
                 count=num_variants,
-                mode="out"
+                # With compaction or regeneration the full set never needs
+                # to leave the GPU
+                mode="device" if compact or regenerate else "out"
             ),
             BufferSpec(
                 binding=2,
                 dtype=Model._model_dtype,
                 count=num_workgroups,
-                mode="out"
+                mode="device" if regenerate else "out"
             ),
             BufferSpec(
                 binding=3,
                 dtype=np.float64,
                 count=num_workgroups,
-                mode="out"
+                mode="device" if regenerate else "out"
             )
         ]
         
+        if regenerate:
+            buffers.append(
+                BufferSpec(
+                    binding=12,
+                    dtype=Model._score_index_dtype,
+                    count=num_variants,
+                    mode="out"
+                )
+            )
+        
+        if compact:
+            buffers += [
+                BufferSpec(
+                    binding=4,
+                    dtype=np.uint32,
+                    count=1,
+                    mode="device",
+                    initial_data=np.zeros(1, dtype=np.uint32)
+                ),
+                BufferSpec(
+                    binding=5,
+                    dtype=Model._model_dtype,
+                    count=max_hits,
+                    mode="device"
+                )
+            ]
+        
+        if histogram:
+            buffers.append(
+                BufferSpec(
+                    binding=6,
+                    dtype=ScoreHistogram._dtype,
+                    count=1,
+                    mode="out",
+                    initial_data=np.zeros(1, dtype=ScoreHistogram._dtype)
+                )
+            )
+        
         print(f"USING SEED: {seed}")
         uniforms = [
             UniformSpec("num_variations", num_variants, "1ui"),
             UniformSpec("seed", seed, "1ui"),
-            UniformSpec("annealing_temperature", temperature, "1d")
-        ]   
+            UniformSpec("annealing_temperature", temperature, "1d"),
+            UniformSpec("error_threshold", error_threshold, "1d")
+        ]
+        if compact:
+            uniforms.append(UniformSpec("compact_capacity", max_hits, "1ui"))
         
         time_start = time.time()
         results = self.program.run(buffers, uniforms, num_invocations=num_variants)
         time_compute = time.time()
         print(f"GPU compute: {(time_compute - time_start):.3f} seconds")
         
-        results = self.program.run(buffers, uniforms, num_invocations=num_variants)
-        
-        # Get workgroup bests
-        workgroup_models = results[2]
-        workgroup_scores = results[3]
-        
-        # Find the best among workgroup bests (tiny array, fast on CPU)
-        best_workgroup_idx = np.argmin(workgroup_scores)
-        best_model = Model.from_struct(workgroup_models[best_workgroup_idx])
-        best_score = workgroup_scores[best_workgroup_idx]
+        if regenerate:
+            # Only the winners' indices leave the GPU; rebuild and re-score
+            # them on the host
+            from host_variation import regenerate_winners
+            pool = top_k * (distinct_pool if distinct_distance is not None and top_k > 1 else 1)
+            raw_results, mismatch = regenerate_winners(self, results[12], pool, seed,
+                                                       temperature, error_threshold)
+            best_model = Model.from_struct(raw_results[0])
+            
+            time_best = time.time()
+            print(f"Regenerate {len(raw_results)} winners: {(time_best - time_compute):.3f} seconds "
+                  f"(max rel score mismatch {mismatch:.1e})")
+            print(f"Best score: {raw_results[0]['score']:.6e}")
+        else:
+            # Get workgroup bests
+            workgroup_models = results[2]
+            workgroup_scores = results[3]
+            
+            # Find the best among workgroup bests (tiny array, fast on CPU)
+            best_workgroup_idx = np.argmin(workgroup_scores)
+            best_model = Model.from_struct(workgroup_models[best_workgroup_idx])
+            best_score = workgroup_scores[best_workgroup_idx]
+            
+            time_best = time.time()
+            print(f"Find best: {(time_best - time_compute):.3f} seconds")
+            print(f"Best score: {best_score:.6e} (from workgroup {best_workgroup_idx})")
         
-        time_best = time.time()
-        print(f"Find best: {(time_best - time_compute):.3f} seconds")
-        print(f"Best score: {best_score:.6e} (from workgroup {best_workgroup_idx})")
+        extra = ()
+        if histogram:
+            self._histogram = ScoreHistogram.from_struct(results[6][0])
+            print(self._histogram.summary('rel_equipotential_err'))
+            if return_histogram:
+                extra = (self._histogram,)
         
-        # If user wants top_k > 1, sort full results
+        # If user wants top_k > 1, sort full results (or just the hits)
         if top_k > 1:
-            raw_results = results[1]
-            #raw_results.sort(order='rel_equipotential_err')
-            raw_results.sort(order='score')
+            if compact:
+                num_hits = int(self.program.read_buffer(4, np.uint32, 1)[0])
+                if num_hits > max_hits:
+                    print(f"\033[1;33mWarning: {num_hits} hits overflowed "
+                          f"max_hits={max_hits}; top {top_k} taken from the first {max_hits}\033[m")
+                    num_hits = max_hits
+                raw_results = self.program.read_buffer(5, Model._model_dtype, num_hits).copy()
+                print(f"Read back {num_hits} hits under error threshold {error_threshold:g}")
+            elif not regenerate:
+                raw_results = results[1]
+            if len(raw_results) == 0:
+                # No variation came in under error_threshold
+                return (best_model, []) + extra
+            # Partial sort: only the candidates that can be returned
+            from model_batch import ModelBatch
+            pool = top_k * (distinct_pool if distinct_distance is not None else 1)
+            raw_results = ModelBatch.from_records(raw_results).top(pool).records
+            if distinct_distance is not None:
+                from clustering import distinct_records
+                raw_results, _ = distinct_records(raw_results[:top_k * distinct_pool], 
+                                                  top_k, distinct_distance)
+                best_model = Model.from_struct(raw_results[0])
             top_models = [Model.from_struct(v) for v in raw_results[:top_k]]
             time_sort = time.time()
             print(f"Sort and convert top {top_k}: {(time_sort - time_best):.3f} seconds")
-            return best_model, top_models
+            return (best_model, top_models) + extra
         else:
-            return best_model, [best_model]
+            return (best_model, [best_model]) + extra
+    
+    def anneal(self, num_generations, num_variants, temperature, seed=None,
+               target_acceptance=0.2, adapt_rate=0.5,
+               min_temperature=1e-6, max_temperature=4.0):
+        """
+        Run a multi-generation search entirely on the GPU with per-layer
+        adaptive temperature.
+        
+        Each generation perturbs the current template, counts per layer how
+        many variations improved that layer's equipotential error, promotes
+        the best variation to the template, and moves each layer's
+        temperature toward target_acceptance. Buffers are uploaded once and
+        read back once; the host only issues dispatches.
+        
+        Args:
+            num_generations: Number of generations to run
+            num_variants: Variations per generation
+            temperature: Initial temperature for every layer
+            seed: Random seed (default: random)
+            target_acceptance: Desired fraction of improving samples per layer
+            adapt_rate: Gain of the multiplicative temperature update
+            min_temperature, max_temperature: Temperature clamp
+        
+        Returns:
+            best_model: The final template, scored
+            layer_temperatures: Final temperature of each layer
+        """
+        # Always scored by error alone
+        program = self._get_program([UniformSpec("error_threshold", 0.0, "1d")],
+                                    ADAPTIVE_TEMPERATURE=1)
+        
+        if seed is None:
+            seed = random.randint(0, 0xFFFFFFFF)
+        
+        num_layers = len(self['layers'])
+        local_size = 256
+        num_workgroups = (num_variants + local_size - 1) // local_size
+        
+        input_array = np.frombuffer(self.to_struct(), dtype=np.uint8)
+        
+        state = np.zeros(1, dtype=Model._anneal_state_dtype)
+        state['template_score'] = 1e30
+        state['layer_temperature'][0, :] = temperature
+        state['template_layer_err'][0, :] = 1e30
+        
+        buffers = [
+            BufferSpec(binding=0, dtype=np.uint8, count=len(input_array),
+                       mode="inout", initial_data=input_array),
+            BufferSpec(binding=1, dtype=Model._model_dtype, count=num_variants,
+                       mode="device"),
+            BufferSpec(binding=2, dtype=Model._model_dtype, count=num_workgroups,
+                       mode="device"),
+            BufferSpec(binding=3, dtype=np.float64, count=num_workgroups,
+                       mode="device"),
+            BufferSpec(binding=7, dtype=Model._anneal_state_dtype, count=1,
+                       mode="inout", initial_data=state),
+            BufferSpec(binding=8, dtype=np.float64, count=num_workgroups * 20,
+                       mode="device"),
+        ]
+        
+        def uniforms(n, generation_seed):
+            return [
+                UniformSpec("num_variations", n, "1ui"),
+                UniformSpec("seed", generation_seed, "1ui"),
+                UniformSpec("annealing_temperature", temperature, "1d"),
+                UniformSpec("error_threshold", 0.0, "1d"),
+                UniformSpec("target_acceptance", target_acceptance, "1d"),
+                UniformSpec("adapt_rate", adapt_rate, "1d"),
+                UniformSpec("min_temperature", min_temperature, "1d"),
+                UniformSpec("max_temperature", max_temperature, "1d"),
+            ]
+        
+        print(f"USING SEED: {seed}")
+        time_start = time.time()
+        
+        program.bind(buffers)
+        # Generation "-1" scores the bare template to seed the acceptance test
+        program.dispatch(uniforms(1, seed), 1)
+        for generation in range(num_generations):
+            generation_seed = (seed + (generation + 1) * 0x9E3779B9) & 0xFFFFFFFF
+            program.dispatch(uniforms(num_variants, generation_seed), num_variants)
+        results = program.read_back(buffers)
+        program.unbind(buffers)
+        
+        time_compute = time.time()
+        print(f"GPU compute ({num_generations} generations): {(time_compute - time_start):.3f} seconds")
+        
+        final_state = results[7][0]
+        layers_struct = np.frombuffer(results[0].tobytes()[16:16 + 40 * 20], 
+                                      dtype=Model._layer_dtype)
+        best = Model({
+            'angular_momentum': self['angular_momentum'],
+            'layers': [
+                {
+                    'abc': [float(l['a']), float(l['b']), float(l['c'])],
+                    'density': float(l['density']),
+                } for l in layers_struct[:num_layers]
+            ]
+        })
+        layer_temperatures = final_state['layer_temperature'][:num_layers].copy()
+        
+        print(f"Template score: {final_state['template_score']:.6e} "
+              f"after {final_state['generation'] - 1} generations")
+        print(f"Layer temperatures: {np.array2string(layer_temperatures, precision=4)}")
+        
+        # Score the final template with the regular explorer
+        best_model, _ = best.explore_variations(1, 0.0, seed=seed)
+        return best_model, layer_temperatures
+    
+    # Pareto archive bins over log10(rel_equipotential_err)
+    PARETO_BINS = 256
+    PARETO_LOG10_MIN = -16
+    PARETO_LOG10_MAX = 0
+    
+    _pareto_archive_dtype = np.dtype([
+        ('energy_bits', np.uint32, (PARETO_BINS,)),
+        ('idx', np.uint32, (PARETO_BINS,)),
+        ('on_front', np.uint32, (PARETO_BINS,)),
+        ('candidate_count', np.uint32),
+        ('workgroups_done', np.uint32),
+    ])
+    
+    def pareto_front(self, num_variants, temperature, seed=None):
+        """
+        Generate variations and return the (rel_equipotential_err,
+        kinetic_energy) trade-off in one dispatch, instead of rerunning
+        explore_variations at many error thresholds.
+        
+        The GPU keeps, per log-spaced error bin, the lowest-energy
+        variation, merges the workgroups' local fronts, and copies out the
+        bins on the global front (PARETO_FRONT).
+        
+        Args:
+            num_variants: Number of variations to generate
+            temperature: Annealing temperature for variation size
+            seed: Random seed (default: random)
+        
+        Returns:
+            List of Models on the front, by increasing error (and so
+            decreasing kinetic energy)
+        """
+        program = self._get_program([UniformSpec("error_threshold", 0.0, "1d")],
+                                    PARETO_FRONT=1, 
+                                     PARETO_BINS=self.PARETO_BINS,
+                                     PARETO_LOG10_MIN=f'({self.PARETO_LOG10_MIN})',
+                                     PARETO_LOG10_MAX=f'({self.PARETO_LOG10_MAX})')
+        
+        if seed is None:
+            seed = random.randint(0, 0xFFFFFFFF)
+        
+        local_size = 256
+        num_workgroups = (num_variants + local_size - 1) // local_size
+        input_array = np.frombuffer(self.to_struct(), dtype=np.uint8)
+        
+        archive = np.zeros(1, dtype=self._pareto_archive_dtype)
+        archive['energy_bits'] = 0xFFFFFFFF
+        
+        buffers = [
+            BufferSpec(binding=0, dtype=np.uint8, count=len(input_array),
+                       mode="in", initial_data=input_array),
+            BufferSpec(binding=1, dtype=Model._model_dtype, count=num_variants,
+                       mode="device"),
+            BufferSpec(binding=2, dtype=Model._model_dtype, count=num_workgroups,
+                       mode="device"),
+            BufferSpec(binding=3, dtype=np.float64, count=num_workgroups,
+                       mode="device"),
+            BufferSpec(binding=9, dtype=self._pareto_archive_dtype, count=1,
+                       mode="out", initial_data=archive),
+            BufferSpec(binding=10, dtype=np.dtype((np.uint32, 4)), 
+                       count=num_workgroups * self.PARETO_BINS, mode="device"),
+            BufferSpec(binding=11, dtype=Model._model_dtype, count=self.PARETO_BINS,
+                       mode="out"),
+        ]
+        
+        uniforms = [
+            UniformSpec("num_variations", num_variants, "1ui"),
+            UniformSpec("seed", seed, "1ui"),
+            UniformSpec("annealing_temperature", temperature, "1d"),
+            UniformSpec("error_threshold", 0.0, "1d")
+        ]
+        
+        time_start = time.time()
+        results = program.run(buffers, uniforms, num_invocations=num_variants)
+        print(f"GPU compute (Pareto front): {(time.time() - time_start):.3f} seconds")
+        
+        on_front = np.nonzero(results[9][0]['on_front'])[0]
+        front = [Model.from_struct(results[11][bin_idx]) for bin_idx in on_front]
+        print(f"Pareto front: {len(front)} points from "
+              f"{results[9][0]['candidate_count']} workgroup candidates")
+        return front
+    
+    @classmethod
+    def explore_batch(cls, models, num_variants, temperature, top_k=None, seed=None,
+                      error_threshold=0.0):
+        """
+        Explore variations of many independent templates in one dispatch.
+        
+        Each template gets its own run of workgroups (MULTI_TEMPLATE), so
+        hundreds of angular momenta or density profiles cost one upload, one
+        dispatch and one readback instead of one of each per template.
+        
+        Args:
+            models: List of template Models
+            num_variants: Variations per template
+            temperature: Annealing temperature for variation size
+            top_k: Number of best results to return per template (default: 1)
+            seed: Random seed (default: random)
+            error_threshold: As in explore_variations (no compaction here)
+        
+        Returns:
+            List of (best_model, top_models) per template, in input order
+        """
+        if top_k is None:
+            top_k = 1
+        
+        # Layer count is compiled in when every template shares it
+        layer_counts = {len(m['layers']) for m in models}
+        num_layers = layer_counts.pop() if len(layer_counts) == 1 else None
+        program = cls._explorer_program(num_layers,
+                                        cls._dispatch_constants(temperature, error_threshold),
+                                        MULTI_TEMPLATE=1)
+        
+        if seed is None:
+            seed = random.randint(0, 0xFFFFFFFF)
+        
+        num_templates = len(models)
+        local_size = 256
+        blocks_per_template = (num_variants + local_size - 1) // local_size
+        slots_per_template = blocks_per_template * local_size
+        num_workgroups = num_templates * blocks_per_template
+        
+        from model_batch import ModelBatch
+        templates = ModelBatch.from_models(models).records
+        
+        buffers = [
+            BufferSpec(binding=0, dtype=Model._model_dtype, count=num_templates,
+                       mode="in", initial_data=templates),
+            BufferSpec(binding=1, dtype=Model._model_dtype, 
+                       count=num_templates * slots_per_template,
+                       mode="out" if top_k > 1 else "device"),
+            BufferSpec(binding=2, dtype=Model._model_dtype, count=num_workgroups,
+                       mode="out"),
+            BufferSpec(binding=3, dtype=np.float64, count=num_workgroups,
+                       mode="out"),
+        ]
+        
+        uniforms = [
+            UniformSpec("num_variations", num_variants, "1ui"),
+            UniformSpec("blocks_per_template", blocks_per_template, "1ui"),
+            UniformSpec("seed", seed, "1ui"),
+            UniformSpec("annealing_temperature", temperature, "1d"),
+            UniformSpec("error_threshold", error_threshold, "1d")
+        ]
+        
+        time_start = time.time()
+        results = program.run(buffers, uniforms, num_invocations=num_workgroups * local_size)
+        print(f"GPU compute ({num_templates} templates x {num_variants}): "
+              f"{(time.time() - time_start):.3f} seconds")
+        
+        # Workgroup bests are grouped by template
+        workgroup_models = results[2].reshape(num_templates, blocks_per_template)
+        workgroup_scores = results[3].reshape(num_templates, blocks_per_template)
+        best_blocks = np.argmin(workgroup_scores, axis=1)
+        
+        if top_k > 1:
+            all_variations = results[1].reshape(num_templates, slots_per_template)[:, :num_variants]
+        
+        batch = []
+        for t in range(num_templates):
+            best_model = Model.from_struct(workgroup_models[t, best_blocks[t]])
+            if top_k > 1:
+                top = ModelBatch.from_records(all_variations[t]).top(top_k)
+                top_models = [Model.from_struct(v) for v in top.records]
+            else:
+                top_models = [best_model]
+            batch.append((best_model, top_models))
+        
+        return batch
+
 
 if __name__ == '__main__':
     
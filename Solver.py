@@ -1,6 +1,7 @@
 # -*- coding: utf-8 -*-
 import sys
 import Model
+import seeding
 import json
 
 
@@ -12,6 +13,10 @@ def main():
     filename = sys.argv[1]
     with open(filename, 'r') as fp:
         model = Model.Model(json.load(fp))
+    
+    if '--warm-start' in sys.argv[2:]:
+        # Start from the analytic Maclaurin/Jacobi shape for this L
+        model = seeding.seed_model(model)
         
     print(json.dumps(model, indent=4))
 
@@ -21,15 +26,25 @@ def main():
     top_k = 50
     seed = None
     
-    best, top_models = model.explore_variations(num_variants, temperature, top_k=top_k, seed=seed)
+    if '--cpu' in sys.argv[2:]:
+        # Same variants as the GPU explorer, evaluated with numpy, and the
+        # same de-duplication done on the host
+        from cpu_explorer import explore_variations_cpu
+        from clustering import distinct_models_host
+        best, top_models = explore_variations_cpu(model, num_variants, temperature,
+                                                  top_k=top_k * 16, seed=seed)
+        top_models = distinct_models_host(top_models, top_k, distance_threshold=1e-3)
+    else:
+        # Mirror images and near-copies are merged on the GPU, so the list
+        # holds top_k distinct basins in canonical (a >= b) form
+        best, top_models = model.explore_variations(num_variants, temperature, top_k=top_k, seed=seed,
+                                                    distinct_distance=1e-3)
 
     print(json.dumps(best, indent=4))
     print(" #      a        b        c     err (x1e6)   total energy")
     print("=== ======== ======== ======== ============ ==============")
     for idx, candidate in enumerate(top_models):
         a, b, c = candidate['layers'][0]['abc']
-        if b>a:
-            a, b = b, a
         err = candidate['rel_equipotential_err']
         energy = candidate['total_energy']
         print(f"{idx+1:3d} {a:8.5f} {b:8.5f} {c:8.5f}  {err*1e6:8.3f}     {energy:8.5f}")
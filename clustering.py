@@ -0,0 +1,108 @@
+# -*- coding: utf-8 -*-
+"""
+Canonical forms and de-duplication of explorer results.
+
+The explorer happily returns both a solution and its mirror image (the
+same body rotated 90 degrees about the spin axis, i.e. every layer's a and
+b swapped), and its top-k list tends to be k near-copies of one basin.
+shader/cluster.glsl.c flips every candidate into canonical form (a >= b on
+the outermost layer) and greedily clusters the score-sorted list, keeping
+the best member of each basin.
+"""
+
+import numpy as np
+
+from compute_harness import ShaderConfig, BufferSpec, UniformSpec
+from Model import Model, harness
+from model_batch import ModelBatch
+
+
+def _get_program():
+    config = ShaderConfig.precision_config("double", "double")
+    return harness.get_program("shader/cluster.glsl.c", config)
+
+
+def canonical(model):
+    """
+    Host-side canonical form of a Model (a >= b on the outermost layer).
+    Always a new plain dict with its own layers, like Model.from_struct, so
+    host and GPU results are the same kind of object.
+    """
+    flip = model['layers'][-1]['abc'][1] > model['layers'][-1]['abc'][0]
+    result = dict(model)
+    result['layers'] = []
+    for layer in model['layers']:
+        layer = dict(layer)
+        a, b, c = layer['abc']
+        layer['abc'] = [b, a, c] if flip else [a, b, c]
+        result['layers'].append(layer)
+    return result
+
+
+def distinct_records(records, k, distance_threshold=1e-3):
+    """
+    Cluster score-sorted Model records on the GPU.
+
+    Args:
+        records: Array of Model._model_dtype, best first
+        k: Maximum number of clusters to return
+        distance_threshold: Largest |log a - log a'| or |log b - log b'| over
+            the layers for two candidates to count as the same basin
+
+    Returns:
+        representatives: Canonicalized records of the first k clusters
+            (empty, with no dispatch, for empty input)
+        cluster_of: Per input record, the index of its representative
+            (0xFFFFFFFF for records past the k-th cluster)
+    """
+    num = len(records)
+    if num == 0:
+        return records[:0].copy(), np.zeros(0, dtype=np.uint32)
+    program = _get_program()
+
+    buffers = [
+        BufferSpec(binding=1, dtype=Model._model_dtype, count=num,
+                   mode="inout", initial_data=records),
+        BufferSpec(binding=2, dtype=np.uint32, count=num,
+                   mode="out", initial_data=np.full(num, 0xFFFFFFFF, dtype=np.uint32)),
+        BufferSpec(binding=3, dtype=np.uint32, count=num + 1,
+                   mode="out"),
+    ]
+    uniforms = [
+        UniformSpec("num_candidates", num, "1ui"),
+        UniformSpec("distance_threshold", distance_threshold, "1f"),
+        UniformSpec("max_clusters", k, "1ui"),
+    ]
+
+    results = program.run(buffers, uniforms, num_invocations=program.local_size_x)
+
+    clusters = results[3]
+    num_clusters = int(clusters[0])
+    representatives = results[1][clusters[1:1 + num_clusters]]
+    return representatives, results[2]
+
+
+def distinct_models(models, k, distance_threshold=1e-3):
+    """distinct_records for a list of Models (best first)."""
+    records = ModelBatch.from_models(models).records
+    representatives, _ = distinct_records(records, k, distance_threshold)
+    return [Model.from_struct(r) for r in representatives]
+
+
+def distinct_models_host(models, k, distance_threshold=1e-3):
+    """
+    distinct_models without the GPU (for cpu_explorer results): the same
+    canonical form and greedy clustering in score order, on the host.
+    """
+    representatives = []
+    log_axes = []
+    for model in models:
+        model = canonical(model)
+        axes = np.log([layer['abc'][:2] for layer in model['layers']])
+        if any(np.max(np.abs(axes - other)) < distance_threshold for other in log_axes):
+            continue
+        representatives.append(model)
+        log_axes.append(axes)
+        if len(representatives) >= k:
+            break
+    return representatives
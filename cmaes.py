@@ -0,0 +1,221 @@
+# -*- coding: utf-8 -*-
+"""
+CMA-ES search over layer shapes with the population evaluated on the GPU.
+
+The search space is (log a, log b) for every layer; c follows from the
+layer's volume. Each generation:
+
+    1. shader/cmaes_sample.glsl.c draws lambda offspring mean + sigma * L z
+       (L = Cholesky factor of C) and scores them with compute_statistics.
+    2. shader/cmaes_recombine.glsl.c ranks them on the GPU and returns the
+       weighted sums over the top mu: y_w, z_w and sum w_i y_i y_i^T.
+    3. The host applies the standard (Hansen) update of the evolution paths,
+       step size and covariance, and refactors C.
+
+Only the recombined sums (and the best offspring, when it improves) are
+read back, so readback is O(dim^2) per generation regardless of lambda.
+"""
+
+import random
+import time
+
+import numpy as np
+
+from compute_harness import ShaderConfig, BufferSpec, UniformSpec
+from Model import Model, harness
+
+
+class CMAES:
+
+    MAX_DIM = 40
+    MAX_LAMBDA = 2048
+
+    _distribution_dtype = np.dtype([
+        ('mean', np.float64, (MAX_DIM,)),
+        ('chol', np.float64, (MAX_DIM * MAX_DIM,)),
+        ('weights', np.float64, (MAX_LAMBDA,)),
+    ])
+
+    _update_dtype = np.dtype([
+        ('best_score', np.float64),
+        ('best_idx', np.uint32),
+        ('_pad', np.uint32),
+        ('y_w', np.float64, (MAX_DIM,)),
+        ('z_w', np.float64, (MAX_DIM,)),
+        ('c_mu', np.float64, (MAX_DIM * MAX_DIM,)),
+    ])
+
+    def __init__(self, model, population_size=1024, sigma=0.05,
+                 error_threshold=0.0, seed=None):
+        """
+        Args:
+            model: Starting Model; its axes are the initial mean, and its
+                angular momentum, volumes and densities are held fixed
+            population_size: lambda (2 to MAX_LAMBDA)
+            sigma: Initial step size in log-axis units
+            error_threshold: Passed through to compute_statistics
+            seed: Random seed (default: random)
+        """
+        if not 2 <= population_size <= self.MAX_LAMBDA:
+            raise ValueError(f"population_size must be between 2 and {self.MAX_LAMBDA}")
+
+        self.model = model
+        self.num_layers = len(model['layers'])
+        self.dim = n = 2 * self.num_layers
+        self.lam = population_size
+        self.mu = population_size // 2
+        self.error_threshold = error_threshold
+        self.seed = random.randint(0, 0xFFFFFFFF) if seed is None else seed
+        self.generation = 0
+
+        # Log-rank recombination weights
+        weights = np.log(self.mu + 0.5) - np.log(np.arange(1, self.mu + 1))
+        self.weights = weights / weights.sum()
+        self.mu_eff = 1.0 / np.sum(self.weights ** 2)
+
+        # Strategy parameters (Hansen, "The CMA Evolution Strategy: A Tutorial")
+        self.c_sigma = (self.mu_eff + 2) / (n + self.mu_eff + 5)
+        self.d_sigma = 1 + 2 * max(0.0, np.sqrt((self.mu_eff - 1) / (n + 1)) - 1) + self.c_sigma
+        self.c_c = (4 + self.mu_eff / n) / (n + 4 + 2 * self.mu_eff / n)
+        self.c_1 = 2 / ((n + 1.3) ** 2 + self.mu_eff)
+        self.c_mu = min(1 - self.c_1,
+                        2 * (self.mu_eff - 2 + 1 / self.mu_eff) / ((n + 2) ** 2 + self.mu_eff))
+        self.chi_n = np.sqrt(n) * (1 - 1 / (4 * n) + 1 / (21 * n * n))
+
+        # Distribution state
+        self.mean = np.array([np.log(layer['abc'][axis])
+                              for layer in model['layers'] for axis in (0, 1)])
+        self.sigma = sigma
+        self.C = np.eye(n)
+        self.L = np.eye(n)
+        self.p_sigma = np.zeros(n)
+        self.p_c = np.zeros(n)
+
+        self.best_score = np.inf
+        self.best_model = None
+
+        config = ShaderConfig.precision_config("double", "double")
+        sample_config = config
+        if error_threshold == 0.0:
+            # Error-only scoring: the kinetic-energy branch compiles out
+            sample_config = config.fold(UniformSpec("error_threshold", 0.0, "1d"))
+        self.sampler = harness.get_program("shader/cmaes_sample.glsl.c", sample_config)
+        self.recombiner = harness.get_program("shader/cmaes_recombine.glsl.c", config)
+
+        self._input_array = np.frombuffer(model.to_struct(), dtype=np.uint8)
+
+    def _distribution(self):
+        n = self.dim
+        dist = np.zeros(1, dtype=self._distribution_dtype)
+        dist['mean'][0, :n] = self.mean
+        dist['chol'][0, :n * n] = self.L.ravel()
+        dist['weights'][0, :self.mu] = self.weights
+        return dist
+
+    def step(self):
+        """Run one generation. Returns the best score of the generation."""
+        n = self.dim
+        generation_seed = (self.seed + self.generation * 0x9E3779B9) & 0xFFFFFFFF
+
+        buffers = [
+            BufferSpec(binding=0, dtype=np.uint8, count=len(self._input_array),
+                       mode="in", initial_data=self._input_array),
+            BufferSpec(binding=1, dtype=Model._model_dtype, count=self.lam,
+                       mode="device"),
+            BufferSpec(binding=2, dtype=self._distribution_dtype, count=1,
+                       mode="in", initial_data=self._distribution()),
+            BufferSpec(binding=3, dtype=np.float64, count=self.lam * n,
+                       mode="device"),
+            BufferSpec(binding=4, dtype=np.float64, count=self.lam * n,
+                       mode="device"),
+            BufferSpec(binding=5, dtype=self._update_dtype, count=1,
+                       mode="out"),
+        ]
+
+        common = [
+            UniformSpec("num_variations", self.lam, "1ui"),
+            UniformSpec("cma_dim", n, "1ui"),
+            UniformSpec("cma_mu", self.mu, "1ui"),
+        ]
+
+        # Both stages see the same binding points; only the sampler owns them
+        self.sampler.bind(buffers)
+        self.sampler.dispatch(common + [
+            UniformSpec("seed", generation_seed, "1ui"),
+            UniformSpec("error_threshold", self.error_threshold, "1d"),
+            UniformSpec("cma_sigma", self.sigma, "1d"),
+        ], self.lam)
+        self.recombiner.dispatch(common, self.recombiner.local_size_x)
+        update = self.sampler.read_back(buffers)[5][0]
+
+        if update['best_score'] < self.best_score:
+            self.best_score = float(update['best_score'])
+            record = self.sampler.read_buffer(1, Model._model_dtype, 1,
+                                              offset=int(update['best_idx']))
+            self.best_model = Model.from_struct(record[0])
+
+        self.sampler.unbind(buffers)
+
+        self._update(update['y_w'][:n], update['z_w'][:n],
+                     update['c_mu'][:n * n].reshape(n, n))
+        self.generation += 1
+
+        return float(update['best_score'])
+
+    def _update(self, y_w, z_w, c_mu):
+        """Standard CMA-ES update from the GPU's weighted sums."""
+        n = self.dim
+
+        self.mean = self.mean + self.sigma * y_w
+
+        # Evolution paths (with C = L L^T, L^-1 y_w = z_w stands in for C^-1/2 y_w)
+        self.p_sigma = ((1 - self.c_sigma) * self.p_sigma
+                        + np.sqrt(self.c_sigma * (2 - self.c_sigma) * self.mu_eff) * z_w)
+        norm_p_sigma = np.linalg.norm(self.p_sigma)
+        h_sigma = (norm_p_sigma / np.sqrt(1 - (1 - self.c_sigma) ** (2 * (self.generation + 1)))
+                   < (1.4 + 2 / (n + 1)) * self.chi_n)
+        self.p_c = ((1 - self.c_c) * self.p_c
+                    + h_sigma * np.sqrt(self.c_c * (2 - self.c_c) * self.mu_eff) * y_w)
+
+        # Covariance: rank-one + rank-mu
+        delta_h = (1 - h_sigma) * self.c_c * (2 - self.c_c)
+        self.C = ((1 - self.c_1 - self.c_mu) * self.C
+                  + self.c_1 * (np.outer(self.p_c, self.p_c) + delta_h * self.C)
+                  + self.c_mu * c_mu)
+        self.C = 0.5 * (self.C + self.C.T)
+
+        self.sigma *= np.exp((self.c_sigma / self.d_sigma) * (norm_p_sigma / self.chi_n - 1))
+
+        try:
+            self.L = np.linalg.cholesky(self.C)
+        except np.linalg.LinAlgError:
+            # Lost positive definiteness to roundoff; nudge the diagonal
+            jitter = 1e-12 * np.trace(self.C) / n
+            self.C += jitter * np.eye(n)
+            self.L = np.linalg.cholesky(self.C)
+
+    def run(self, num_generations, tol=None):
+        """
+        Run up to num_generations (stopping early once the best score drops
+        below tol). Returns the best Model found.
+        """
+        time_start = time.time()
+        for _ in range(num_generations):
+            score = self.step()
+            print(f"gen {self.generation:4d}: best {score:.6e}  "
+                  f"overall {self.best_score:.6e}  sigma {self.sigma:.3e}")
+            if tol is not None and self.best_score < tol:
+                break
+        print(f"CMA-ES: {self.generation} generations in {time.time() - time_start:.3f} seconds")
+        return self.best_model
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    best = CMAES(model).run(100, tol=1e-10)
+    print(json.dumps(best, indent=4))
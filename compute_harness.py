@@ -3,6 +3,7 @@ Generic GL 4.6 Compute Shader Framework (PyQt5 + PyOpenGL)
 """
 from __future__ import annotations
 
+import re
 import sys
 from dataclasses import dataclass, field
 from typing import Optional, Dict, Any, List
@@ -20,6 +21,28 @@ from OpenGL.GL import shaders as gl_shaders
 class ShaderConfig:
     """Configuration for shader compilation."""
     defines: Dict[str, str] = field(default_factory=dict)
+    # Uniforms compiled in as constants (name -> UniformSpec); see fold()
+    constants: Dict[str, 'UniformSpec'] = field(default_factory=dict)
+    
+    def fold(self, *uniforms: 'UniformSpec') -> 'ShaderConfig':
+        """
+        Copy of this config with the given uniforms compiled in as constants.
+        
+        The shader's `uniform <type> <name>;` declaration is rewritten to
+        `const <type> <name> = <value>;` and `CONST_<name>` is defined, so
+        branches on the value fold away at compile time. Values passed for
+        folded uniforms at dispatch time are ignored.
+        """
+        folded = ShaderConfig(defines=dict(self.defines), constants=dict(self.constants))
+        for spec in uniforms:
+            folded.constants[spec.name] = spec
+        return folded
+    
+    def key(self) -> tuple:
+        """Hashable identity of the compiled variant."""
+        return (tuple(sorted((k, str(v)) for k, v in self.defines.items())),
+                tuple(sorted((name, spec.uniform_type, repr(spec.value)) 
+                             for name, spec in self.constants.items())))
 
     @staticmethod
     def precision_config(buffer_precision: str = "double", 
@@ -37,7 +60,7 @@ class BufferSpec:
     binding: int
     dtype: np.dtype
     count: int  # Number of elements
-    mode: str = "out"  # "in", "out", or "inout"
+    mode: str = "out"  # "in", "out", "inout", or "device" (never read back automatically)
     initial_data: Optional[np.ndarray] = None
     
     @property
@@ -57,7 +80,7 @@ class BufferSpec:
             return GL.GL_STATIC_DRAW
         elif self.mode == "out":
             return GL.GL_DYNAMIC_READ
-        else:  # inout
+        else:  # inout, device
             return GL.GL_DYNAMIC_COPY
 
 
@@ -67,6 +90,86 @@ class UniformSpec:
     name: str
     value: Any
     uniform_type: str  # "1ui", "1i", "1f", "3f", "4fv", etc.
+    
+    def glsl_literal(self) -> str:
+        """The value as a GLSL constant expression (scalar and vector types)."""
+        kind = self.uniform_type[1:]
+        size = int(self.uniform_type[0])
+        
+        def scalar(v):
+            if kind == "d":
+                v = float(v)
+                if not np.isfinite(v):
+                    raise ValueError(f"Cannot fold non-finite uniform '{self.name}'")
+                return f"{v!r}LF" if ('.' in repr(v) or 'e' in repr(v)) else f"{v!r}.0LF"
+            if kind == "f":
+                v = float(np.float32(v))
+                if not np.isfinite(v):
+                    raise ValueError(f"Cannot fold non-finite uniform '{self.name}'")
+                return f"{v!r}" if ('.' in repr(v) or 'e' in repr(v)) else f"{v!r}.0"
+            if kind == "ui":
+                return f"{int(v)}u"
+            if kind == "i":
+                return f"{int(v)}"
+            raise ValueError(f"Cannot fold uniform '{self.name}' of type {self.uniform_type}")
+        
+        if size == 1:
+            return scalar(self.value)
+        prefix = {"d": "dvec", "f": "vec", "ui": "uvec", "i": "ivec"}[kind]
+        return f"{prefix}{size}({', '.join(scalar(v) for v in self.value)})"
+
+
+# Uniform type -> glUniform* call, looked up once per uniform instead of
+# walking an if-chain
+_UNIFORM_SETTERS = {
+    # Scalars
+    "1i": lambda loc, v: GL.glUniform1i(loc, int(v)),
+    "1ui": lambda loc, v: GL.glUniform1ui(loc, np.uint32(v)),
+    "1f": lambda loc, v: GL.glUniform1f(loc, float(v)),
+    "1d": lambda loc, v: GL.glUniform1d(loc, float(v)),
+    
+    # Vectors
+    "2f": lambda loc, v: GL.glUniform2f(loc, *v),
+    "3f": lambda loc, v: GL.glUniform3f(loc, *v),
+    "4f": lambda loc, v: GL.glUniform4f(loc, *v),
+    "2i": lambda loc, v: GL.glUniform2i(loc, *v),
+    "3i": lambda loc, v: GL.glUniform3i(loc, *v),
+    "4i": lambda loc, v: GL.glUniform4i(loc, *v),
+    "2ui": lambda loc, v: GL.glUniform2ui(loc, *v),
+    "3ui": lambda loc, v: GL.glUniform3ui(loc, *v),
+    "4ui": lambda loc, v: GL.glUniform4ui(loc, *v),
+    "2d": lambda loc, v: GL.glUniform2d(loc, *v),
+    "3d": lambda loc, v: GL.glUniform3d(loc, *v),
+    "4d": lambda loc, v: GL.glUniform4d(loc, *v),
+    
+    # Arrays
+    "1fv": lambda loc, v: GL.glUniform1fv(loc, len(v), v),
+    "2fv": lambda loc, v: GL.glUniform2fv(loc, len(v)//2, v),
+    "3fv": lambda loc, v: GL.glUniform3fv(loc, len(v)//3, v),
+    "4fv": lambda loc, v: GL.glUniform4fv(loc, len(v)//4, v),
+    "1iv": lambda loc, v: GL.glUniform1iv(loc, len(v), v),
+    "2iv": lambda loc, v: GL.glUniform2iv(loc, len(v)//2, v),
+    "3iv": lambda loc, v: GL.glUniform3iv(loc, len(v)//3, v),
+    "4iv": lambda loc, v: GL.glUniform4iv(loc, len(v)//4, v),
+    "1uiv": lambda loc, v: GL.glUniform1uiv(loc, len(v), v),
+    "2uiv": lambda loc, v: GL.glUniform2uiv(loc, len(v)//2, v),
+    "3uiv": lambda loc, v: GL.glUniform3uiv(loc, len(v)//3, v),
+    "4uiv": lambda loc, v: GL.glUniform4uiv(loc, len(v)//4, v),
+    "1dv": lambda loc, v: GL.glUniform1dv(loc, len(v), v),
+    "2dv": lambda loc, v: GL.glUniform2dv(loc, len(v)//2, v),
+    "3dv": lambda loc, v: GL.glUniform3dv(loc, len(v)//3, v),
+    "4dv": lambda loc, v: GL.glUniform4dv(loc, len(v)//4, v),
+    
+    # Matrices
+    "matrix2fv": lambda loc, v: GL.glUniformMatrix2fv(loc, 1, GL.GL_FALSE, v),
+    "matrix3fv": lambda loc, v: GL.glUniformMatrix3fv(loc, 1, GL.GL_FALSE, v),
+    "matrix4fv": lambda loc, v: GL.glUniformMatrix4fv(loc, 1, GL.GL_FALSE, v),
+    "matrix2dv": lambda loc, v: GL.glUniformMatrix2dv(loc, 1, GL.GL_FALSE, v),
+    "matrix3dv": lambda loc, v: GL.glUniformMatrix3dv(loc, 1, GL.GL_FALSE, v),
+    "matrix4dv": lambda loc, v: GL.glUniformMatrix4dv(loc, 1, GL.GL_FALSE, v),
+}
+
+_SCALAR_UNIFORM_TYPES = frozenset(("1i", "1ui", "1f", "1d"))
 
 
 class GLSLComputeProgram:
@@ -81,6 +184,9 @@ class GLSLComputeProgram:
         self.source_code = self._load_and_configure_shader(shader_path)
         self.program = 0
         self.ssbos: Dict[int, int] = {}  # binding -> buffer_id
+        self._ssbo_sizes: Dict[int, int] = {}  # binding -> allocated bytes
+        self._uniform_locations: Dict[str, int] = {}
+        self._uniform_values: Dict[int, tuple] = {}  # location -> last scalar set
         self.local_size_x = 256  # Default
         
         self._compile()
@@ -118,7 +224,19 @@ class GLSLComputeProgram:
         """Load shader and inject configuration defines."""
         source = self._load_shader(path)
         
-        if not self.config.defines:
+        # Fold constant uniforms: `uniform T name;` -> `const T name = value;`
+        for name, spec in self.config.constants.items():
+            pattern = re.compile(rf'^(\s*)uniform\s+(\w+)\s+{re.escape(name)}\s*;', re.M)
+            literal = spec.glsl_literal()
+            source, count = pattern.subn(rf'\1const \2 {name} = {literal};', source)
+            if count == 0:
+                print(f"\033[1;33mWarning: folded uniform '{name}' not declared in {path}\033[m")
+        
+        defines = dict(self.config.defines)
+        for name, spec in self.config.constants.items():
+            defines[f"CONST_{name}"] = spec.glsl_literal()
+        
+        if not defines:
             return source
         
         # Inject defines at the top (after #version)
@@ -131,7 +249,7 @@ class GLSLComputeProgram:
         
         # Build define block
         define_block = []
-        for key, value in self.config.defines.items():
+        for key, value in defines.items():
             define = f"#define {key} {value}"
             define_block.append(define)
         
@@ -159,7 +277,11 @@ class GLSLComputeProgram:
             raise RuntimeError(msg) from None
     
     def _setup_buffer(self, spec: BufferSpec) -> int:
-        """Create or update an SSBO based on spec."""
+        """
+        Create or update an SSBO based on spec. A buffer that already has
+        the right size is reused: only its data is uploaded (if any), with no
+        reallocation.
+        """
         if spec.binding not in self.ssbos:
             self.ssbos[spec.binding] = GL.glGenBuffers(1)
         
@@ -170,132 +292,88 @@ class GLSLComputeProgram:
         byte_size = int(spec.byte_size)
         
         if spec.initial_data is not None:
-            # Upload data
             assert spec.initial_data.nbytes == byte_size
-            GL.glBufferData(GL.GL_SHADER_STORAGE_BUFFER, 
-                          byte_size, 
-                          spec.initial_data, 
-                          spec.usage)
+        
+        if self._ssbo_sizes.get(spec.binding) == byte_size:
+            if spec.initial_data is not None:
+                GL.glBufferSubData(GL.GL_SHADER_STORAGE_BUFFER, 0,
+                                   byte_size,
+                                   spec.initial_data)
         else:
-            # Allocate empty
+            # Allocate, uploading the data if there is any
             GL.glBufferData(GL.GL_SHADER_STORAGE_BUFFER, 
                           byte_size, 
-                          None, 
+                          spec.initial_data, 
                           spec.usage)
+            self._ssbo_sizes[spec.binding] = byte_size
         
         GL.glBindBuffer(GL.GL_SHADER_STORAGE_BUFFER, 0)
         return ssbo
     
+    def _uniform_location(self, name: str) -> int:
+        """Uniform location, queried once per program (-1: not found)."""
+        loc = self._uniform_locations.get(name)
+        if loc is None:
+            loc = GL.glGetUniformLocation(self.program, name)
+            self._uniform_locations[name] = loc
+            if loc == -1:
+                print(f"\033[1;33mWarning: uniform '{name}' not found\033[m")
+        return loc
+    
     def _set_uniform(self, spec: UniformSpec):
         """Set a uniform value."""
-        loc = GL.glGetUniformLocation(self.program, spec.name)
+        if spec.name in self.config.constants:
+            return  # compiled in
+        
+        loc = self._uniform_location(spec.name)
         if loc == -1:
-            print(f"\033[1;33mWarning: uniform '{spec.name}' not found\033[m")
             return
         
         utype = spec.uniform_type
         value = spec.value
         
-        # Scalars
-        if utype == "1i":
-            GL.glUniform1i(loc, int(value))
-        elif utype == "1ui":
-            GL.glUniform1ui(loc, np.uint32(value))
-        elif utype == "1f":
-            GL.glUniform1f(loc, float(value))
-        elif utype == "1d":
-            GL.glUniform1d(loc, float(value))
-        
-        # Vectors
-        elif utype == "2f":
-            GL.glUniform2f(loc, *value)
-        elif utype == "3f":
-            GL.glUniform3f(loc, *value)
-        elif utype == "4f":
-            GL.glUniform4f(loc, *value)
-        elif utype == "2i":
-            GL.glUniform2i(loc, *value)
-        elif utype == "3i":
-            GL.glUniform3i(loc, *value)
-        elif utype == "4i":
-            GL.glUniform4i(loc, *value)
-        elif utype == "2ui":
-            GL.glUniform2ui(loc, *value)
-        elif utype == "3ui":
-            GL.glUniform3ui(loc, *value)
-        elif utype == "4ui":
-            GL.glUniform4ui(loc, *value)
-        elif utype == "2d":
-            GL.glUniform2d(loc, *value)
-        elif utype == "3d":
-            GL.glUniform3d(loc, *value)
-        elif utype == "4d":
-            GL.glUniform4d(loc, *value)
-        
-        # Arrays
-        elif utype == "1fv":
-            GL.glUniform1fv(loc, len(value), value)
-        elif utype == "2fv":
-            GL.glUniform2fv(loc, len(value)//2, value)
-        elif utype == "3fv":
-            GL.glUniform3fv(loc, len(value)//3, value)
-        elif utype == "4fv":
-            GL.glUniform4fv(loc, len(value)//4, value)
-        elif utype == "1iv":
-            GL.glUniform1iv(loc, len(value), value)
-        elif utype == "2iv":
-            GL.glUniform2iv(loc, len(value)//2, value)
-        elif utype == "3iv":
-            GL.glUniform3iv(loc, len(value)//3, value)
-        elif utype == "4iv":
-            GL.glUniform4iv(loc, len(value)//4, value)
-        elif utype == "1uiv":
-            GL.glUniform1uiv(loc, len(value), value)
-        elif utype == "2uiv":
-            GL.glUniform2uiv(loc, len(value)//2, value)
-        elif utype == "3uiv":
-            GL.glUniform3uiv(loc, len(value)//3, value)
-        elif utype == "4uiv":
-            GL.glUniform4uiv(loc, len(value)//4, value)
-        elif utype == "1dv":
-            GL.glUniform1dv(loc, len(value), value)
-        elif utype == "2dv":
-            GL.glUniform2dv(loc, len(value)//2, value)
-        elif utype == "3dv":
-            GL.glUniform3dv(loc, len(value)//3, value)
-        elif utype == "4dv":
-            GL.glUniform4dv(loc, len(value)//4, value)
-        
-        # Matrices
-        elif utype == "matrix2fv":
-            GL.glUniformMatrix2fv(loc, 1, GL.GL_FALSE, value)
-        elif utype == "matrix3fv":
-            GL.glUniformMatrix3fv(loc, 1, GL.GL_FALSE, value)
-        elif utype == "matrix4fv":
-            GL.glUniformMatrix4fv(loc, 1, GL.GL_FALSE, value)
-        elif utype == "matrix2dv":
-            GL.glUniformMatrix2dv(loc, 1, GL.GL_FALSE, value)
-        elif utype == "matrix3dv":
-            GL.glUniformMatrix3dv(loc, 1, GL.GL_FALSE, value)
-        elif utype == "matrix4dv":
-            GL.glUniformMatrix4dv(loc, 1, GL.GL_FALSE, value)
+        # Uniform values live in the program object, so an unchanged scalar
+        # need not be set again (multi-dispatch loops mostly change the seed)
+        scalar = utype in _SCALAR_UNIFORM_TYPES
+        if scalar and self._uniform_values.get(loc) == (utype, value):
+            return
         
-        else:
+        setter = _UNIFORM_SETTERS.get(utype)
+        if setter is None:
             raise ValueError(f"Unsupported uniform type: {utype}")
+        setter(loc, value)
+        
+        if scalar:
+            self._uniform_values[loc] = (utype, value)
     
     def _read_buffer(self, spec: BufferSpec) -> np.ndarray:
         """Read data back from an SSBO."""
-        ssbo = self.ssbos[spec.binding]
+        return self.read_buffer(spec.binding, spec.dtype, spec.count)
+    
+    def read_buffer(self, binding: int, dtype, count: int, offset: int = 0) -> np.ndarray:
+        """
+        Read `count` elements of `dtype` from the SSBO at `binding`, starting
+        at element `offset`. Used for partial readback of "device" buffers,
+        e.g. reading a counter first and then only that many records.
+        """
+        if isinstance(dtype, type) and dtype == np.uint8:
+            itemsize = 1
+        else:
+            itemsize = np.dtype(dtype).itemsize
+        
+        if count == 0:
+            return np.empty(0, dtype=dtype)
+        
+        ssbo = self.ssbos[binding]
         GL.glBindBuffer(GL.GL_SHADER_STORAGE_BUFFER, ssbo)
         
-        byte_size = int(spec.byte_size)
         raw_bytes = GL.glGetBufferSubData(GL.GL_SHADER_STORAGE_BUFFER, 
-                                         0, 
-                                         byte_size)
+                                         int(offset * itemsize), 
+                                         int(count * itemsize))
         
         GL.glBindBuffer(GL.GL_SHADER_STORAGE_BUFFER, 0)
         
-        return np.frombuffer(raw_bytes, dtype=spec.dtype, count=spec.count)
+        return np.frombuffer(raw_bytes, dtype=dtype, count=count)
     
     def run(self, 
             buffers: List[BufferSpec],
@@ -313,20 +391,49 @@ class GLSLComputeProgram:
         
         Returns:
             Dictionary mapping binding -> output data for "out" and "inout" buffers
+            ("device" buffers stay on the GPU; fetch them with read_buffer())
         """
-        if uniforms is None:
-            uniforms = []
-        
-        if local_size_x is None:
-            local_size_x = self.local_size_x
-        
         if num_invocations is None:
             num_invocations = buffers[0].count if buffers else 0
         
-        # Setup all buffers
+        self.bind(buffers)
+        self.dispatch(uniforms, num_invocations, local_size_x)
+        results = self.read_back(buffers)
+        self.unbind(buffers)
+        
+        return results
+    
+    # ------------------------------------------------------------------------
+    # The stages of run(), for callers that dispatch several times against
+    # the same buffers (e.g. a multi-generation loop kept entirely on the GPU):
+    #
+    #     program.bind(buffers)
+    #     for g in range(n):
+    #         program.dispatch(uniforms_for(g), num_invocations)
+    #     results = program.read_back(buffers)
+    #     program.unbind(buffers)
+    # ------------------------------------------------------------------------
+    
+    def bind(self, buffers: List[BufferSpec]):
+        """Allocate/upload all buffers and bind them to their binding points."""
         for spec in buffers:
             ssbo = self._setup_buffer(spec)
             GL.glBindBufferBase(GL.GL_SHADER_STORAGE_BUFFER, spec.binding, ssbo)
+    
+    def dispatch(self,
+                 uniforms: Optional[List[UniformSpec]],
+                 num_invocations: int,
+                 local_size_x: Optional[int] = None):
+        """
+        Set uniforms and dispatch against the currently bound buffers.
+        Does not wait for completion; successive dispatches are ordered by
+        a memory barrier.
+        """
+        if uniforms is None:
+            uniforms = []
+        
+        if local_size_x is None:
+            local_size_x = self.local_size_x
         
         # Use program
         GL.glUseProgram(self.program)
@@ -339,22 +446,31 @@ class GLSLComputeProgram:
         groups_x = (num_invocations + local_size_x - 1) // local_size_x
         GL.glDispatchCompute(groups_x, 1, 1)
         
-        # Synchronize
+        # Make writes visible to the next dispatch and to readback
         GL.glMemoryBarrier(GL.GL_ALL_BARRIER_BITS)
-        GL.glFinish()
+    
+    def read_back(self, buffers: List[BufferSpec], wait: bool = True) -> Dict[int, np.ndarray]:
+        """
+        Wait for the GPU and read back "out" and "inout" buffers. With
+        wait=False the caller has already waited on a fence for this
+        program's work (glFinish would also wait for everything queued
+        after it).
+        """
+        if wait:
+            GL.glFinish()
         
-        # Read back output buffers
         results = {}
         for spec in buffers:
             if spec.mode in ("out", "inout"):
                 results[spec.binding] = self._read_buffer(spec)
         
-        # Cleanup
+        return results
+    
+    def unbind(self, buffers: List[BufferSpec]):
+        """Release the program and binding points (buffers stay allocated)."""
         GL.glUseProgram(0)
         for spec in buffers:
             GL.glBindBufferBase(GL.GL_SHADER_STORAGE_BUFFER, spec.binding, 0)
-        
-        return results
     
     def cleanup(self):
         """Free GPU resources."""
@@ -365,6 +481,9 @@ class GLSLComputeProgram:
         for ssbo in self.ssbos.values():
             GL.glDeleteBuffers(1, [ssbo])
         self.ssbos.clear()
+        self._ssbo_sizes.clear()
+        self._uniform_locations.clear()
+        self._uniform_values.clear()
 
 
 class GLSLComputeHarness:
@@ -401,6 +520,9 @@ class GLSLComputeHarness:
             raise RuntimeError("Failed to make context current")
         
         self._print_gl_info()
+        
+        # (shader path, config key) -> program; see get_program()
+        self._program_cache: Dict[tuple, GLSLComputeProgram] = {}
     
     def _print_gl_info(self):
         """Print OpenGL version info."""
@@ -415,6 +537,40 @@ class GLSLComputeHarness:
                       config: Optional[ShaderConfig] = None) -> GLSLComputeProgram:
         """Create a compute program from a shader file."""
         return GLSLComputeProgram(self, shader_path, config)
+    
+    def get_program(self, shader_path: str,
+                    config: Optional[ShaderConfig] = None,
+                    instance: int = 0) -> GLSLComputeProgram:
+        """
+        Like create_program, but compiles each (shader, defines, folded
+        constants) variant only once and returns the cached program after.
+        Cached programs share their buffers between callers; work that must
+        have its own buffers while another dispatch is in flight asks for a
+        different `instance` (a separately compiled copy).
+        """
+        config = config or ShaderConfig()
+        key = (shader_path, config.key(), instance)
+        if key not in self._program_cache:
+            self._program_cache[key] = GLSLComputeProgram(self, shader_path, config)
+        return self._program_cache[key]
+    
+    # ------------------------------------------------------------------------
+    # Fences, for overlapping host work with dispatches in flight
+    # ------------------------------------------------------------------------
+    
+    def insert_fence(self):
+        """Fence behind every command issued so far (flushed, so it signals)."""
+        sync = GL.glFenceSync(GL.GL_SYNC_GPU_COMMANDS_COMPLETE, 0)
+        GL.glFlush()
+        return sync
+    
+    def fence_signaled(self, sync) -> bool:
+        """Poll a fence without blocking."""
+        status = GL.glClientWaitSync(sync, 0, 0)
+        return status in (GL.GL_ALREADY_SIGNALED, GL.GL_CONDITION_SATISFIED)
+    
+    def delete_fence(self, sync):
+        GL.glDeleteSync(sync)
 
 
 # ============================================================================
@@ -0,0 +1,229 @@
+# -*- coding: utf-8 -*-
+"""
+Pseudo-arclength continuation along equilibrium sequences.
+
+Starting from a solved Model, trace the curve F(x, L) = 0 in
+(log a_i, log b_i, L) space with a predictor-corrector scheme:
+
+    predictor:  u_k = u + h_k t     for a ladder of step sizes h_k
+    corrector:  Newton on [F(u); t . (u - u_k)] = 0 for every u_k at once
+
+Every corrector iteration is one dispatch of shader/newton_krylov.glsl.c.
+Each candidate is expanded into 2n + 1 work items (one per unit direction
+in x, plus one along L), so one dispatch returns the full Jacobian
+[J_x | dF/dL] of every candidate; the (2n+1)^2 solves are numpy. The
+largest step that converges is taken and the ladder adapts.
+
+Bifurcations (e.g. Maclaurin -> Jacobi) show up as sign changes of
+det(J_x) between consecutive points; they are located by linear
+interpolation in L and reported. Branch switching is left to the caller
+(perturb the bifurcating model along the null vector and continue).
+"""
+
+import time
+
+import numpy as np
+
+from Model import Model
+from newton_krylov import _Batch
+
+
+class Continuation:
+
+    def __init__(self, model, step=0.02, num_candidates=4, min_step=1e-6,
+                 max_step=0.5, tolerance=1e-11, max_corrector=8):
+        """
+        Args:
+            model: Solved starting Model (e.g. from solve_newton_krylov)
+            step: Initial arclength step, in units where log-axes and
+                L / L_scale are comparable (L_scale = |L| of `model`)
+            num_candidates: Steps tried per dispatch: step, step/2, ...
+            min_step, max_step: Arclength step bounds
+            tolerance: Corrector convergence threshold on ||F||
+            max_corrector: Corrector iterations (dispatches) per step
+        """
+        self.model = model
+        self.n = 2 * len(model['layers'])
+        self.step = step
+        self.num_candidates = num_candidates
+        self.min_step = min_step
+        self.max_step = max_step
+        self.tolerance = tolerance
+        self.max_corrector = max_corrector
+
+        self.L_scale = abs(model['angular_momentum']) or 1.0
+
+        # One item per (candidate, direction); copies of the same model
+        self.directions = self.n + 1
+        self.batch = _Batch([model] * (num_candidates * self.directions))
+        self.x0 = self.batch.slices[0]
+
+    def _jacobians(self, U):
+        """
+        Residuals and Jacobians [J_x | dF/dlambda] at each row of U
+        (x then lambda = L / L_scale). One dispatch.
+        """
+        n, d = self.n, self.directions
+        K = len(U)
+
+        x = np.zeros_like(self.batch.x)
+        v = np.zeros_like(self.batch.x)
+        L = np.zeros(len(self.batch.items))
+        dL = np.zeros(len(self.batch.items))
+        for k in range(K):
+            for j in range(d):
+                item = k * d + j
+                s = self.batch.slices[item]
+                x[s] = U[k, :n]
+                L[item] = U[k, n] * self.L_scale
+                if j < n:
+                    v[s.start + j] = 1.0
+                else:
+                    dL[item] = self.L_scale
+        # Unused candidate slots just repeat the last one
+        for item in range(K * d, len(self.batch.items)):
+            s = self.batch.slices[item]
+            x[s] = U[-1, :n]
+            L[item] = U[-1, n] * self.L_scale
+
+        F_all, JV = self.batch.evaluate(x, v, angular_momentum=L, d_angular_momentum=dL)
+
+        F = np.empty((K, n))
+        J = np.empty((K, n, n + 1))
+        for k in range(K):
+            F[k] = F_all[self.batch.slices[k * d]]
+            for j in range(d):
+                J[k, :, j] = JV[self.batch.slices[k * d + j]]
+        return F, J
+
+    @staticmethod
+    def _tangent(J, previous=None):
+        """Unit null vector of the n x (n+1) Jacobian, oriented along `previous`."""
+        t = np.linalg.svd(J)[2][-1]
+        if previous is not None:
+            if np.dot(t, previous) < 0:
+                t = -t
+        elif t[-1] < 0:
+            t = -t          # start out toward increasing L
+        return t
+
+    def _correct(self, u, t, steps):
+        """
+        Batched corrector for the predictors u + h t, h in steps.
+        Returns (points, converged, iterations, J) per candidate.
+        """
+        n = self.n
+        K = len(steps)
+        predictors = u[None, :] + steps[:, None] * t[None, :]
+        U = predictors.copy()
+        converged = np.zeros(K, dtype=bool)
+        iterations = np.zeros(K, dtype=int)
+
+        for it in range(self.max_corrector):
+            F, J = self._jacobians(U)
+            self.dispatches += 1
+            norms = np.linalg.norm(F, axis=1)
+            converged = np.isfinite(norms) & (norms <= self.tolerance)
+            if converged.all():
+                break
+            for k in range(K):
+                if converged[k] or not np.isfinite(norms[k]):
+                    continue
+                A = np.vstack([J[k], t])
+                rhs = -np.concatenate([F[k], [np.dot(t, U[k] - predictors[k])]])
+                try:
+                    U[k] += np.linalg.solve(A, rhs)
+                except np.linalg.LinAlgError:
+                    U[k, :] = np.nan
+                iterations[k] = it + 1
+
+        return U, converged, iterations, J
+
+    def _model_at(self, u):
+        x = self.batch.x.copy()
+        x[self.x0] = u[:self.n]
+        model = self.batch.to_models(x)[0]
+        model['angular_momentum'] = float(u[self.n] * self.L_scale)
+        return model
+
+    def run(self, num_steps, L_max=None):
+        """
+        Take up to num_steps continuation steps (stopping once L passes
+        L_max, if given).
+
+        Returns:
+            sequence: List of solved Models along the curve
+            bifurcations: List of dicts with the interpolated
+                'angular_momentum' and the sequence 'index' just past
+                each sign change of det(J_x)
+        """
+        n = self.n
+        u = np.concatenate([self.batch.x[self.x0],
+                            [self.model['angular_momentum'] / self.L_scale]])
+
+        F, J = self._jacobians(u[None, :])
+        t = self._tangent(J[0])
+        det = np.linalg.det(J[0][:, :n])
+
+        sequence = [self._model_at(u)]
+        bifurcations = []
+        h = self.step
+        time_start = time.time()
+        self.dispatches = 1
+
+        for step_idx in range(num_steps):
+            steps = h * 0.5 ** np.arange(self.num_candidates)
+            U, converged, iterations, J = self._correct(u, t, steps)
+
+            if not converged.any():
+                h *= 0.5 ** self.num_candidates
+                if h < self.min_step:
+                    print(f"Continuation stalled at L={u[n] * self.L_scale:.6e}")
+                    break
+                continue
+
+            k = int(np.argmax(converged))      # largest converged step
+            u_new = U[k]
+            t_new = self._tangent(J[k], previous=t)
+
+            # J[k] is from the last corrector iterate, close enough for the sign
+            det_new = np.linalg.det(J[k][:, :n])
+            if np.sign(det_new) * np.sign(det) < 0:
+                # Linear interpolation of det in L between the two points
+                frac = det / (det - det_new)
+                L_bif = (u[n] + frac * (u_new[n] - u[n])) * self.L_scale
+                bifurcations.append({'angular_momentum': float(L_bif),
+                                     'index': len(sequence)})
+                print(f"Bifurcation near L={L_bif:.6e}")
+            det = det_new
+
+            u, t = u_new, t_new
+            sequence.append(self._model_at(u))
+
+            # Grow after an easy full step, otherwise continue at the step taken
+            if k == 0 and iterations[0] <= 3:
+                h = min(2.0 * h, self.max_step)
+            else:
+                h = max(steps[k], self.min_step)
+
+            if L_max is not None and u[n] * self.L_scale >= L_max:
+                break
+
+        print(f"Continuation: {len(sequence)} points, {len(bifurcations)} bifurcations, "
+              f"{self.dispatches} dispatches in {time.time() - time_start:.3f} seconds")
+
+        return sequence, bifurcations
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    sequence, bifurcations = Continuation(model).run(200)
+    for point in sequence[::10]:
+        axes = ", ".join(f"{x:.6f}" for x in point['layers'][-1]['abc'])
+        print(f"L={point['angular_momentum']:10.6f}  outer axes ({axes})")
+    print(json.dumps(bifurcations, indent=4))
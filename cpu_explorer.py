@@ -0,0 +1,69 @@
+# -*- coding: utf-8 -*-
+"""
+CPU version of Model.explore_variations for nodes without a GPU.
+
+Variations are generated and scored by host_variation, vectorized across
+variants: each chunk of indices is one set of numpy arrays, so the PCG
+streams, perturbations and Carlson integrals run as array operations
+over the whole chunk instead of one variant at a time. Chunks are handed
+to a thread pool as workers free up (numpy and scipy.special release the
+GIL in their inner loops), and every chunk goes straight into a shared
+TopKCollector.
+
+Variation idx uses the same RNG stream as on the GPU, so for the same
+(model, seed, temperature) both explorers visit the same variants and
+agree on the winners up to rounding in the scores.
+"""
+
+import os
+import random
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+from Model import Model
+from topk import TopKCollector
+from host_variation import regenerate_records
+
+
+def explore_variations_cpu(model, num_variants, temperature, top_k=None, seed=None,
+                           error_threshold=0.0, chunk_size=4096, num_threads=None):
+    """
+    Generate variations of the model on the CPU and return the best ones.
+
+    Args:
+        model: Template Model
+        num_variants, temperature, top_k, seed, error_threshold: As in
+            Model.explore_variations
+        chunk_size: Variants evaluated together as one set of arrays
+        num_threads: Worker threads (default: one per core)
+
+    Returns:
+        best_model: The single best Model found
+        top_models: List of top_k Models
+    """
+    if top_k is None:
+        top_k = 1
+    if seed is None:
+        seed = random.randint(0, 0xFFFFFFFF)
+    if num_threads is None:
+        num_threads = os.cpu_count() or 1
+
+    def run_chunk(start):
+        indices = np.arange(start, min(start + chunk_size, num_variants), dtype=np.uint32)
+        collector.offer(regenerate_records(model, seed, indices, temperature, error_threshold))
+
+    print(f"USING SEED: {seed}")
+    time_start = time.time()
+    collector = TopKCollector(top_k)
+    with ThreadPoolExecutor(max_workers=num_threads) as pool:
+        list(pool.map(run_chunk, range(0, num_variants, chunk_size)))
+    top = collector.records()
+    elapsed = time.time() - time_start
+    print(f"CPU compute ({num_threads} threads): {elapsed:.3f} seconds "
+          f"({num_variants / max(elapsed, 1e-9):.3g} variants/s)")
+    print(f"Best score: {top['score'][0]:.6e}")
+
+    top_models = [Model.from_struct(r) for r in top]
+    return top_models[0], top_models
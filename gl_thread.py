@@ -0,0 +1,188 @@
+# -*- coding: utf-8 -*-
+"""
+A single GL-owning thread that executes work submitted from any thread.
+
+The harness's context is current on one thread only, so GL calls (every
+program.run, explore_variations, ...) from other threads are undefined
+behaviour. GLSubmissionThread takes the context over on a thread of its
+own and drains a queue of submissions, returning a Future for each:
+
+    gl = GLSubmissionThread().start()
+    future = gl.explore(model, 100000, 0.1)      # from any thread
+    best, top_models = future.result()
+    gl.submit(lambda: model.anneal(50, 65536, 0.1)).result()
+    gl.stop()                                     # context returns to caller
+
+Explorer requests that arrive back to back and share their parameters are
+combined into one Model.explore_batch dispatch (MULTI_TEMPLATE), so many
+clients cost one upload, one dispatch and one readback. Submissions still
+run in the order they were queued. Between start() and stop() nothing
+else may touch GL.
+"""
+
+import queue
+import threading
+from concurrent.futures import Future
+
+from PyQt5.QtCore import QThread
+
+from Model import Model, harness
+
+
+_STOP = object()
+
+
+class _Explore:
+    """A queued explorer request (batched when it carries no seed)."""
+
+    def __init__(self, model, num_variants, temperature, top_k, error_threshold, seed):
+        self.model = model
+        self.args = (num_variants, temperature, top_k, error_threshold)
+        self.seed = seed
+        self.future = Future()
+
+
+class GLSubmissionThread:
+
+    def __init__(self, max_batch=64):
+        """
+        Args:
+            max_batch: Most submissions drained and executed together
+        """
+        self.max_batch = max_batch
+        self._queue = queue.Queue()
+        self._thread = None
+        self._handoff = queue.Queue()
+        self._owner = None
+
+    # ------------------------------------------------------------------------
+    # Lifetime (call from the thread that currently owns the context)
+    # ------------------------------------------------------------------------
+
+    def start(self):
+        """Move the context to a new GL thread and start draining."""
+        self._owner = QThread.currentThread()
+        self._thread = threading.Thread(target=self._run, name="gl-submission", daemon=True)
+        self._thread.start()
+
+        # QObjects can only be pushed to another thread by their owner
+        gl_qthread = self._handoff.get()
+        harness.context.doneCurrent()
+        harness.context.moveToThread(gl_qthread)
+        self._handoff.put(None)
+
+        error = self._handoff.get()
+        if error is not None:
+            raise error
+        return self
+
+    def stop(self):
+        """Finish queued work, then give the context back to the caller."""
+        self._queue.put(_STOP)
+        self._thread.join()
+        if not harness.context.makeCurrent(harness.surface):
+            raise RuntimeError("Failed to make context current")
+
+    # ------------------------------------------------------------------------
+    # Submission (any thread)
+    # ------------------------------------------------------------------------
+
+    def submit(self, fn, *args, **kwargs):
+        """Run fn(*args, **kwargs) on the GL thread. Returns a Future."""
+        future = Future()
+        self._queue.put((fn, args, kwargs, future))
+        return future
+
+    def explore(self, model, num_variants, temperature, top_k=1, error_threshold=0.0,
+                seed=None):
+        """
+        Future of (best_model, top_models) as Model.explore_variations.
+        Requests with seed=None may be batched with others.
+        """
+        request = _Explore(model, num_variants, temperature, top_k, error_threshold, seed)
+        self._queue.put(request)
+        return request.future
+
+    # ------------------------------------------------------------------------
+    # GL thread
+    # ------------------------------------------------------------------------
+
+    def _run(self):
+        self._handoff.put(QThread.currentThread())
+        self._handoff.get()
+        if not harness.context.makeCurrent(harness.surface):
+            self._handoff.put(RuntimeError("GL thread failed to make context current"))
+            return
+        self._handoff.put(None)
+
+        stopping = False
+        while not stopping:
+            jobs = [self._queue.get()]
+            while len(jobs) < self.max_batch:
+                try:
+                    jobs.append(self._queue.get_nowait())
+                except queue.Empty:
+                    break
+            if _STOP in jobs:
+                stopping = True
+                jobs = [job for job in jobs if job is not _STOP]
+            self._execute(jobs)
+
+        harness.context.doneCurrent()
+        harness.context.moveToThread(self._owner)
+
+    def _execute(self, jobs):
+        # Jobs run in submission order: only a run of consecutive unseeded
+        # explores with the same parameters is batched, and anything else
+        # flushes the run first
+        run = []
+        for job in jobs:
+            if isinstance(job, _Explore) and job.seed is None:
+                if run and job.args != run[0].args:
+                    self._explore_batch(run)
+                    run = []
+                run.append(job)
+                continue
+            self._explore_batch(run)
+            run = []
+            if isinstance(job, _Explore):
+                self._call(job.future, job.model.explore_variations, *job.args[:2],
+                           top_k=job.args[2], error_threshold=job.args[3], seed=job.seed)
+            else:
+                fn, args, kwargs, future = job
+                self._call(future, fn, *args, **kwargs)
+        self._explore_batch(run)
+
+    def _explore_batch(self, requests):
+        """Unseeded explores sharing their parameters, as one dispatch."""
+        if not requests:
+            return
+        num_variants, temperature, top_k, error_threshold = requests[0].args
+        if len(requests) == 1:
+            request = requests[0]
+            self._call(request.future, request.model.explore_variations,
+                       num_variants, temperature, top_k=top_k,
+                       error_threshold=error_threshold)
+            return
+        requests = [r for r in requests if r.future.set_running_or_notify_cancel()]
+        if not requests:
+            return
+        try:
+            results = Model.explore_batch([r.model for r in requests], num_variants,
+                                          temperature, top_k=top_k,
+                                          error_threshold=error_threshold)
+        except Exception as e:
+            for request in requests:
+                request.future.set_exception(e)
+        else:
+            for request, result in zip(requests, results):
+                request.future.set_result(result)
+
+    @staticmethod
+    def _call(future, fn, *args, **kwargs):
+        if not future.set_running_or_notify_cancel():
+            return
+        try:
+            future.set_result(fn(*args, **kwargs))
+        except Exception as e:
+            future.set_exception(e)
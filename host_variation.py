@@ -0,0 +1,250 @@
+# -*- coding: utf-8 -*-
+"""
+Host-side regeneration of explorer variations.
+
+Variation idx of a dispatch is a deterministic function of the template,
+the seed, idx and the temperature: the explorer seeds PCG with
+(seed + idx, idx), perturbs every layer with perturb_axes and mirrors the
+model onto a >= b on the outer layer. This module mirrors
+shader/random.glsl.c, shader/variation.glsl.c and dexp from
+shader/dmath.glsl.c operation for operation (double, add/multiply only, no
+fused multiply-add on either side), so the regenerated axes are bit-exact.
+That lets the GPU return only (score, idx) pairs (SCORE_INDEX) and the
+host rebuild the winners.
+
+compute_statistics is a numpy port of shader/statistics.glsl.c using
+scipy's Carlson integrals; its scores agree with the GPU's to rounding,
+not bit for bit.
+
+Everything is vectorized over variations.
+"""
+
+import numpy as np
+from scipy.special import elliprd, elliprf
+
+from Model import Model
+
+
+# ============================================================================
+# PCG (shader/random.glsl.c)
+# ============================================================================
+
+_PCG_MULT = np.uint32(747796405)
+_PCG_WORD = np.uint32(277803737)
+
+
+def pcg_hash(state, inc):
+    """One PCG step on uint32 arrays. Returns (new state, output)."""
+    old = state
+    state = old * _PCG_MULT + inc
+    word = ((old >> ((old >> np.uint32(28)) + np.uint32(4))) ^ old) * _PCG_WORD
+    return state, (word >> np.uint32(22)) ^ word
+
+
+def init_pcg(seed, sequence):
+    """initPCG for arrays of (seed, sequence). Returns (state, inc)."""
+    seed = np.asarray(seed, dtype=np.uint32)
+    inc = (np.asarray(sequence, dtype=np.uint32) << np.uint32(1)) | np.uint32(1)
+    state, _ = pcg_hash(np.zeros_like(inc), inc)
+    state, _ = pcg_hash(state + seed, inc)
+    return state, inc
+
+
+def pcg_double(state, inc):
+    state, value = pcg_hash(state, inc)
+    return state, value.astype(np.float64) * (1.0 / 4294967296.0)
+
+
+# ============================================================================
+# dexp (shader/dmath.glsl.c)
+# ============================================================================
+
+_LOG2E = 1.44269504088896338700
+_LN2_HI = 6.93147180369123816490e-01
+_LN2_LO = 1.90821492927058770002e-10
+_INV_K = [0.0, 1.0, 0.5, 0.3333333333333333, 0.25, 0.2,
+          0.16666666666666666, 0.14285714285714285, 0.125,
+          0.1111111111111111, 0.1, 0.09090909090909091,
+          0.08333333333333333, 0.07692307692307693]
+
+
+def dexp(x):
+    x = np.asarray(x, dtype=np.float64)
+    n = np.rint(x * _LOG2E)  # round half to even, like roundEven
+    r = (x - n * _LN2_HI) - n * _LN2_LO
+    p = np.ones_like(r)
+    for k in range(13, 0, -1):
+        p = 1.0 + p * r * _INV_K[k]
+    return np.ldexp(p, n.astype(np.int32))
+
+
+# ============================================================================
+# perturb_axes (shader/variation.glsl.c)
+# ============================================================================
+
+_LN2 = 0.6931471805599453
+
+
+def perturb_axes(state, inc, temperature, a, b, c):
+    """Vectorized perturb_axes. Returns (state, a, b, c)."""
+    state, u1 = pcg_double(state, inc)
+    state, u2 = pcg_double(state, inc)
+    state, u3 = pcg_double(state, inc)
+    rand1, rand2, rand3 = 1.5 * u1, 1.5 * u2, 1.5 * u3
+    avg = (rand1 + rand2 + rand3) * 0.3333333333333333
+
+    e1 = (rand1 - avg) * temperature * _LN2
+    e2 = (rand2 - avg) * temperature * _LN2
+    a = a * dexp(e1)
+    b = b * dexp(e2)
+    c = c * dexp(-(e1 + e2))
+    return state, a, b, c
+
+
+# ============================================================================
+# Regeneration
+# ============================================================================
+
+def regenerate_records(template, seed, indices, temperature, error_threshold=0.0):
+    """
+    Rebuild explorer variations from their indices.
+
+    Args:
+        template: The Model explore_variations was called on
+        seed: The dispatch's seed
+        indices: Variation indices (as returned in SCORE_INDEX pairs)
+        temperature: The dispatch's annealing temperature
+        error_threshold: The dispatch's error_threshold (for the score)
+
+    Returns:
+        Array of Model._model_dtype, statistics filled in by
+        compute_statistics
+    """
+    indices = np.asarray(indices, dtype=np.uint32)
+    num = len(indices)
+    template_record = np.frombuffer(template.to_struct() + b'\x00' * 8,
+                                    dtype=Model._model_dtype)[0]
+    num_layers = int(template_record['num_layers'])
+
+    records = np.zeros(num, dtype=Model._model_dtype)
+    records['angular_momentum'] = template_record['angular_momentum']
+    records['num_layers'] = num_layers
+    records['layers'] = template_record['layers']
+
+    state, inc = init_pcg(np.uint32(seed) + indices, indices)
+    for i in range(num_layers):
+        a = np.full(num, template_record['layers'][i]['a'])
+        b = np.full(num, template_record['layers'][i]['b'])
+        c = np.full(num, template_record['layers'][i]['c'])
+        if temperature != 0.0:
+            state, a, b, c = perturb_axes(state, inc, temperature, a, b, c)
+        records['layers'][:, i]['a'] = a
+        records['layers'][:, i]['b'] = b
+        records['layers'][:, i]['c'] = c
+
+    # Mirror image with a >= b on the outer layer, all layers together
+    layers = records['layers'][:, :num_layers]
+    outer = layers[:, num_layers - 1]
+    swap = (outer['b'] > outer['a'])[:, None]
+    a, b = layers['a'].copy(), layers['b'].copy()
+    records['layers']['a'][:, :num_layers] = np.where(swap, b, a)
+    records['layers']['b'][:, :num_layers] = np.where(swap, a, b)
+
+    compute_statistics(records, error_threshold)
+    return records
+
+
+def regenerate_winners(template, pairs, count, seed, temperature, error_threshold=0.0):
+    """
+    Rebuild the `count` best variations of a SCORE_INDEX dispatch.
+
+    Args:
+        pairs: The dispatch's (score, idx) pairs (Model._score_index_dtype)
+        count: Number of winners
+        template, seed, temperature, error_threshold: As in regenerate_records
+
+    Returns:
+        records: The winners re-scored on the host, best first
+        mismatch: Largest relative difference between host and GPU scores
+    """
+    count = min(count, len(pairs))
+    winners = pairs[np.argpartition(pairs['score'], count - 1)[:count]]
+    winners = winners[np.argsort(winners['score'], kind='stable')]
+    records = regenerate_records(template, seed, winners['idx'], temperature, error_threshold)
+    mismatch = np.max(np.abs(records['score'] - winners['score'])
+                      / np.maximum(np.abs(winners['score']), 1e-300))
+    order = np.argsort(records['score'], kind='stable')
+    return records[order], mismatch
+
+
+# ============================================================================
+# compute_statistics (shader/statistics.glsl.c)
+# ============================================================================
+
+def _axis_potential(a2, b2, c2, abc, x2, lam, axis):
+    """pi (I(lam) - A_axis(lam) x^2) per unit density, elementwise."""
+    sa, sb, sc = a2 + lam, b2 + lam, c2 + lam
+    I = 2.0 * abc * elliprf(sa, sb, sc)
+    if axis == 0:
+        A = (2.0 / 3.0) * abc * elliprd(sb, sc, sa)
+    elif axis == 1:
+        A = (2.0 / 3.0) * abc * elliprd(sa, sc, sb)
+    else:
+        A = (2.0 / 3.0) * abc * elliprd(sa, sb, sc)
+    return np.pi * (I - A * x2)
+
+
+def compute_statistics(records, error_threshold=0.0):
+    """
+    Fill in the statistics and score of Model records (in place). All
+    records must have the same number of layers.
+    """
+    num_layers = int(records['num_layers'][0])
+    layers = records['layers'][:, :num_layers]
+    a, b, c = layers['a'], layers['b'], layers['c']
+    density = layers['density']
+
+    moi = np.sum(density * a * b * c * (a * a + b * b), axis=1) * (4.0 / 15.0) * np.pi
+    ang_vel = records['angular_momentum'] / moi
+
+    # [variation, surface layer, mass layer]
+    surf = np.arange(num_layers)[:, None]
+    mass = np.arange(num_layers)[None, :]
+    inside = (surf <= mass)[None]
+    ma2, mb2, mc2 = (a * a)[:, None, :], (b * b)[:, None, :], (c * c)[:, None, :]
+    abc = (a * b * c)[:, None, :]
+    rho = density[:, None, :]
+
+    valid = np.all(inside
+                   | ((a[:, :, None] > a[:, None, :])
+                      & (b[:, :, None] > b[:, None, :])
+                      & (c[:, :, None] > c[:, None, :])), axis=(1, 2))
+
+    pots = []
+    with np.errstate(invalid='ignore', divide='ignore'):
+        for axis, (x, m2) in enumerate(((a, ma2), (b, mb2), (c, mc2))):
+            x2 = (x * x)[:, :, None]
+            lam = np.where(inside, 0.0, x2 - m2)
+            pot = np.sum(rho * _axis_potential(ma2, mb2, mc2, abc, x2, lam, axis), axis=2)
+            if axis < 2:
+                pot += 0.5 * ang_vel[:, None] ** 2 * (x * x)
+            pots.append(pot)
+        pots = np.stack(pots)
+        max_pot, min_pot = pots.max(axis=0), pots.min(axis=0)
+        err = np.sum((max_pot - min_pot) / min_pot, axis=1) / num_layers
+
+    records['rel_equipotential_err'] = np.where(valid, err, 1e30)
+    records['moment_of_inertia'] = moi
+    records['angular_velocity'] = ang_vel
+    records['potential_energy'] = 0.0
+    records['kinetic_energy'] = 0.5 * moi * ang_vel * ang_vel
+    records['total_energy'] = records['kinetic_energy']
+    records['virial_ratio'] = 0.0
+    records['padding_sentinel'] = 3.14159265358979323846
+
+    if error_threshold == 0.0:
+        records['score'] = records['rel_equipotential_err']
+    else:
+        records['score'] = np.where(records['rel_equipotential_err'] < error_threshold,
+                                    records['kinetic_energy'], 1e30)
+    return records
@@ -0,0 +1,206 @@
+# -*- coding: utf-8 -*-
+"""
+Multi-resolution maps of equipotential error over (b/a, c/a).
+
+shader/landscape.glsl.c scores a regular base grid at fixed angular
+momentum and density profile (every layer gets the same axis ratios at its
+own volume), then refines, level by level, the cells that contain low
+error or a steep change in it. All levels run back to back on the GPU and
+the map comes back once, as a flat quadtree: each cell records its level,
+grid indices, the error and score at its four corners, and the index of
+its first child.
+"""
+
+import time
+
+import numpy as np
+
+from compute_harness import ShaderConfig, BufferSpec, UniformSpec
+from Model import Model, harness
+
+
+NO_CHILDREN = 0xFFFFFFFF
+MAX_LEVELS = 16
+
+_cell_dtype = np.dtype([
+    ('level', np.uint32),                  # offset 0
+    ('i', np.uint32),                      # offset 4
+    ('j', np.uint32),                      # offset 8
+    ('first_child', np.uint32),            # offset 12
+    ('corner_err', np.float64, (4,)),      # offset 16
+    ('corner_score', np.float64, (4,)),    # offset 48
+    # Total: 80 bytes
+])
+
+_state_dtype = np.dtype([
+    ('cell_count', np.uint32),
+    ('workgroups_done', np.uint32),
+    ('overflow', np.uint32),
+    ('first_overflow', np.uint32),
+    ('level_begin', np.uint32, (MAX_LEVELS + 2,)),
+])
+
+
+def _get_program(error_threshold):
+    config = ShaderConfig.precision_config("double", "double")
+    config.defines["LANDSCAPE_MAX_LEVELS"] = MAX_LEVELS
+    if error_threshold == 0.0:
+        # Error-only scoring: the kinetic-energy branch compiles out
+        config = config.fold(UniformSpec("error_threshold", 0.0, "1d"))
+    return harness.get_program("shader/landscape.glsl.c", config)
+
+
+class Landscape:
+    """A quadtree map returned by map_landscape."""
+
+    def __init__(self, cells, level_begin, base_cells, ratio_min, ratio_max):
+        self.cells = cells
+        self.level_begin = level_begin
+        self.base_cells = base_cells
+        self.ratio_min = np.asarray(ratio_min, dtype=np.float64)
+        self.ratio_max = np.asarray(ratio_max, dtype=np.float64)
+
+    @property
+    def num_levels(self):
+        return len(self.level_begin) - 1
+
+    def level(self, level):
+        """Cells of one level."""
+        return self.cells[self.level_begin[level]:self.level_begin[level + 1]]
+
+    def leaves(self):
+        return self.cells[self.cells['first_child'] == NO_CHILDREN]
+
+    def cell_bounds(self, cells):
+        """(b/a, c/a) of each cell's lower and upper corners."""
+        size = (self.ratio_max - self.ratio_min) / (self.base_cells << cells['level'])[:, None]
+        lower = self.ratio_min + size * np.stack([cells['i'], cells['j']], axis=1)
+        return lower, lower + size
+
+    def rasterize(self, field='corner_err'):
+        """
+        Paint the leaves onto the finest grid (log10 of the mean corner
+        value), for plotting. Rows index c/a, columns b/a.
+        """
+        finest = self.num_levels - 1
+        side = self.base_cells << finest
+        image = np.full((side, side), np.nan)
+        for cell in self.leaves():
+            span = 1 << (finest - cell['level'])
+            i0, j0 = cell['i'] * span, cell['j'] * span
+            value = np.log10(np.mean(cell[field]))
+            image[j0:j0 + span, i0:i0 + span] = value
+        return image
+
+    def minima(self, count=10):
+        """(b/a, c/a, err) of the lowest-error corners among the leaves."""
+        leaves = self.leaves()
+        lower, upper = self.cell_bounds(leaves)
+        best = np.argsort(leaves['corner_err'].min(axis=1))[:count]
+        points = []
+        for k in best:
+            corner = int(np.argmin(leaves['corner_err'][k]))
+            ratio = np.where([corner & 1, corner >> 1], upper[k], lower[k])
+            points.append((float(ratio[0]), float(ratio[1]),
+                           float(leaves['corner_err'][k, corner])))
+        return points
+
+
+def map_landscape(model, ratio_min=(0.1, 0.1), ratio_max=(1.0, 1.0), base_cells=32,
+                  max_level=5, refine_error=1e-3, refine_gradient=1.0,
+                  capacity=1 << 20, num_workgroups=256, error_threshold=0.0):
+    """
+    Map equipotential error over (b/a, c/a) for a template model.
+
+    Args:
+        model: Template; its angular momentum, layer volumes and densities
+            are used as is
+        ratio_min, ratio_max: (b/a, c/a) corners of the map
+        base_cells: Cells per side at level 0
+        max_level: Deepest refinement level (< MAX_LEVELS)
+        refine_error: Refine cells with a corner error below this
+        refine_gradient: ...or whose corner errors span more decades than this
+        capacity: Cell list size; refinement stops when it fills
+        num_workgroups: Workgroups per level dispatch (64 cells each per pass)
+        error_threshold: Passed through to compute_statistics
+
+    Returns:
+        Landscape
+    """
+    if max_level >= MAX_LEVELS:
+        raise ValueError(f"max_level must be < {MAX_LEVELS}")
+
+    program = _get_program(error_threshold)
+    num_base = base_cells * base_cells
+
+    cells = np.zeros(capacity, dtype=_cell_dtype)
+    jj, ii = np.divmod(np.arange(num_base, dtype=np.uint32), base_cells)
+    cells['i'][:num_base] = ii
+    cells['j'][:num_base] = jj
+    cells['first_child'][:num_base] = NO_CHILDREN
+
+    state = np.zeros(1, dtype=_state_dtype)
+    state['cell_count'] = num_base
+    state['first_overflow'] = 0xFFFFFFFF
+    state['level_begin'][0, 1] = num_base
+
+    input_array = np.frombuffer(model.to_struct(), dtype=np.uint8)
+    local_size = 256
+
+    buffers = [
+        BufferSpec(binding=0, dtype=np.uint8, count=len(input_array),
+                   mode="in", initial_data=input_array),
+        BufferSpec(binding=1, dtype=Model._model_dtype, count=num_workgroups * local_size,
+                   mode="device"),
+        BufferSpec(binding=2, dtype=_cell_dtype, count=capacity,
+                   mode="device", initial_data=cells),
+        BufferSpec(binding=3, dtype=_state_dtype, count=1,
+                   mode="out", initial_data=state),
+    ]
+
+    time_start = time.time()
+
+    program.bind(buffers)
+    for level in range(max_level + 1):
+        program.dispatch([
+            UniformSpec("level", level, "1ui"),
+            UniformSpec("max_level", max_level, "1ui"),
+            UniformSpec("base_cells", base_cells, "1ui"),
+            UniformSpec("ratio_min", tuple(ratio_min), "2d"),
+            UniformSpec("ratio_max", tuple(ratio_max), "2d"),
+            UniformSpec("refine_error", refine_error, "1d"),
+            UniformSpec("refine_gradient", refine_gradient, "1d"),
+            UniformSpec("capacity", capacity, "1ui"),
+            UniformSpec("error_threshold", error_threshold, "1d"),
+        ], num_workgroups * local_size)
+    final_state = program.read_back(buffers)[3][0]
+    cell_count = int(final_state['cell_count'])
+    cells = program.read_buffer(2, _cell_dtype, cell_count).copy()
+    program.unbind(buffers)
+
+    level_begin = final_state['level_begin'][:max_level + 2].astype(np.int64)
+    # Once a level produces no children, every later level is empty too
+    num_levels = int((np.diff(level_begin) > 0).sum())
+    level_begin = level_begin[:num_levels + 1]
+
+    print(f"Landscape: {cell_count} cells over {num_levels} levels "
+          f"in {time.time() - time_start:.3f} seconds")
+    if final_state['overflow']:
+        print(f"\033[1;33mWarning: {final_state['overflow']} cells not refined "
+              f"(capacity {capacity} reached)\033[m")
+
+    return Landscape(cells, level_begin, base_cells, ratio_min, ratio_max)
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    landscape = map_landscape(model)
+    for level in range(landscape.num_levels):
+        print(f"level {level}: {len(landscape.level(level))} cells")
+    for b, c, err in landscape.minima():
+        print(f"b/a={b:.6f}  c/a={c:.6f}  err={err:.3e}")
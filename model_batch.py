@@ -0,0 +1,164 @@
+# -*- coding: utf-8 -*-
+"""
+Many models in one growable array of std430 Model records.
+
+A Model is a dict with a list of layer dicts, which is convenient for one
+template and wasteful for a million results: Model.from_struct builds a
+dict per record and to_struct packs bytes field by field. ModelBatch keeps
+the records in a single numpy array of Model._model_dtype instead:
+
+    - the array *is* the std430 layout, so `batch.records` is passed to a
+      BufferSpec as initial_data (or wraps a readback) without copying
+    - per-field columns (`batch.a`, `batch.score`, ...) are numpy views, so
+      filtering, sorting and top-k never touch Python objects
+    - appends grow the storage geometrically, so building a batch a chunk
+      at a time is amortized O(1) per record
+
+Only the models that are finally wanted are converted with to_models().
+"""
+
+import numpy as np
+
+from Model import Model
+
+
+_SENTINEL = 3.14159265358979323846
+
+_STAT_FIELDS = ('rel_equipotential_err', 'total_energy', 'angular_velocity',
+                'moment_of_inertia', 'potential_energy', 'kinetic_energy',
+                'virial_ratio')
+
+
+class ModelBatch:
+
+    dtype = Model._model_dtype
+
+    def __init__(self, capacity=0):
+        self._storage = np.zeros(capacity, dtype=self.dtype)
+        self._size = 0
+
+    # ------------------------------------------------------------------------
+    # Construction
+    # ------------------------------------------------------------------------
+
+    @classmethod
+    def from_records(cls, records, copy=False):
+        """Batch over an array of Model._model_dtype (a view unless copy)."""
+        records = np.asarray(records)
+        if records.dtype != cls.dtype:
+            records = np.frombuffer(records, dtype=cls.dtype)
+        batch = cls.__new__(cls)
+        batch._storage = records.copy() if copy else records
+        batch._size = len(records)
+        return batch
+
+    @classmethod
+    def from_models(cls, models):
+        """Pack Models (or Model-like dicts) into a new batch."""
+        batch = cls(len(models))
+        batch.extend(models)
+        return batch
+
+    def reserve(self, capacity):
+        """Make room for `capacity` records without further reallocation."""
+        if capacity > len(self._storage):
+            storage = np.zeros(capacity, dtype=self.dtype)
+            storage[:self._size] = self._storage[:self._size]
+            self._storage = storage
+
+    def _grow(self, extra):
+        needed = self._size + extra
+        if needed > len(self._storage):
+            self.reserve(max(needed, 2 * len(self._storage), 16))
+
+    def append_records(self, records):
+        """Append an array of records (e.g. a readback) to the batch."""
+        records = np.asarray(records, dtype=self.dtype)
+        self._grow(len(records))
+        self._storage[self._size:self._size + len(records)] = records
+        self._size += len(records)
+
+    def extend(self, models):
+        """Append Models (or Model-like dicts)."""
+        self._grow(len(models))
+        for model in models:
+            record = self._storage[self._size]
+            layers = model['layers']
+            record['angular_momentum'] = model['angular_momentum']
+            record['num_layers'] = len(layers)
+            record['layers'] = 0.0
+            for i, layer in enumerate(layers):
+                a, b, c = layer['abc']
+                r = layer.get('r', np.cbrt(a * b * c))
+                record['layers'][i] = (a, b, c, r, layer['density'])
+            for name in _STAT_FIELDS:
+                record[name] = model.get(name, 0.0)
+            record['padding_sentinel'] = _SENTINEL
+            record['score'] = model.get('score', 0.0)
+            self._size += 1
+
+    # ------------------------------------------------------------------------
+    # Views
+    # ------------------------------------------------------------------------
+
+    @property
+    def records(self):
+        """The std430 records (a view; upload it as-is)."""
+        return self._storage[:self._size]
+
+    def __len__(self):
+        return self._size
+
+    def __getitem__(self, index):
+        """Slice, mask or index array -> ModelBatch (an int gives a Model)."""
+        if np.isscalar(index):
+            return self.model(int(index))
+        return ModelBatch.from_records(self.records[index])
+
+    def __getattr__(self, name):
+        # Columns: record fields, and layer fields as (N, 20) arrays
+        if name.startswith('_'):
+            raise AttributeError(name)
+        records = self.records
+        if name in self.dtype.names:
+            return records[name]
+        if name in Model._layer_dtype.names:
+            return records['layers'][name]
+        raise AttributeError(name)
+
+    # ------------------------------------------------------------------------
+    # Selection
+    # ------------------------------------------------------------------------
+
+    def filter(self, mask):
+        """New batch with the records where mask is true."""
+        return ModelBatch.from_records(self.records[np.asarray(mask, dtype=bool)])
+
+    def sort(self, order='score'):
+        """Sort in place by a record field, ascending."""
+        records = self.records
+        records[:] = records[np.argsort(records[order], kind='stable')]
+        return self
+
+    def top(self, k, order='score'):
+        """New batch with the k lowest records by `order`, sorted."""
+        records = self.records
+        k = min(k, len(records))
+        if k == 0:
+            return ModelBatch()
+        best = np.argpartition(records[order], k - 1)[:k]
+        best = best[np.argsort(records[order][best], kind='stable')]
+        return ModelBatch.from_records(records[best])
+
+    # ------------------------------------------------------------------------
+    # Conversion
+    # ------------------------------------------------------------------------
+
+    def model(self, i):
+        """Record i as a Model."""
+        return Model(Model.from_struct(self.records[i]))
+
+    def to_models(self, limit=None):
+        """The first `limit` records (default: all) as Models."""
+        count = len(self) if limit is None else min(limit, len(self))
+        return [self.model(i) for i in range(count)]
@@ -0,0 +1,178 @@
+# -*- coding: utf-8 -*-
+"""
+Coarse-to-fine refinement in the number of layers.
+
+A many-layer model is first solved with a few layers carrying the same
+mass distribution, then the layer count is increased level by level. Each
+level starts from the previous solution interpolated onto the finer
+layers, so the expensive fine levels only have to polish:
+
+    restrict:  fine density profile -> K layers, shell masses preserved
+    prolong:   coarse axes -> fine layers, by interpolating the axis
+               ratios log(a/r), log(b/r) against volume radius r
+
+Layers are ordered inside out, and layer densities are superposed
+increments (shell density = sum of the increments of the enclosing
+layers), as everywhere else.
+
+Each level is refined with the batched Newton-Krylov solver or with the
+explorer's on-GPU annealing.
+"""
+
+import time
+
+import numpy as np
+
+from Model import Model
+from newton_krylov import solve_newton_krylov
+import seeding
+
+
+def _radii(model):
+    return np.array([np.cbrt(np.prod(layer['abc'])) for layer in model['layers']])
+
+
+def _shell_densities(model):
+    """Density of each shell (between consecutive layers), inside out."""
+    increments = np.array([layer['density'] for layer in model['layers']])
+    return np.cumsum(increments[::-1])[::-1]
+
+
+def restrict(model, num_layers):
+    """
+    K-layer version of `model` with the same outer surface and total mass.
+
+    Coarse layers sit at fine layer radii (always including the outermost),
+    and each coarse shell's density is the mass-weighted mean of the fine
+    shells it covers. Axes are copied from the fine layers at those radii.
+    """
+    fine = len(model['layers'])
+    if num_layers >= fine:
+        return Model({'angular_momentum': model['angular_momentum'],
+                      'layers': [dict(layer) for layer in model['layers']]})
+
+    r = _radii(model)
+    shell = _shell_densities(model)
+    shell_volume = np.diff(np.concatenate(([0.0], r ** 3)))
+
+    # Fine layers kept, evenly spaced in index, ending at the surface
+    keep = np.unique(np.round(np.linspace(0, fine - 1, num_layers + 1)[1:]).astype(int))
+
+    coarse_shell = []
+    start = 0
+    for k in keep:
+        mass = np.sum(shell[start:k + 1] * shell_volume[start:k + 1])
+        coarse_shell.append(mass / np.sum(shell_volume[start:k + 1]))
+        start = k + 1
+    coarse_shell = np.array(coarse_shell)
+    increments = coarse_shell - np.append(coarse_shell[1:], 0.0)
+
+    layers = []
+    for k, density in zip(keep, increments):
+        layers.append({'abc': list(model['layers'][k]['abc']), 'density': float(density)})
+    return Model({'angular_momentum': model['angular_momentum'], 'layers': layers})
+
+
+def prolong(coarse, fine):
+    """
+    Axes for the layers of `fine` interpolated from the solved `coarse`
+    model. Volumes and densities come from `fine`.
+    """
+    r_coarse = _radii(coarse)
+    log_ratio_a = np.log([layer['abc'][0] for layer in coarse['layers']]) - np.log(r_coarse)
+    log_ratio_b = np.log([layer['abc'][1] for layer in coarse['layers']]) - np.log(r_coarse)
+
+    r_fine = _radii(fine)
+    # np.interp holds the end values outside the coarse range
+    la = np.interp(r_fine, r_coarse, log_ratio_a)
+    lb = np.interp(r_fine, r_coarse, log_ratio_b)
+
+    layers = []
+    for layer, r, ra, rb in zip(fine['layers'], r_fine, la, lb):
+        a, b = r * np.exp(ra), r * np.exp(rb)
+        layers.append({'abc': [float(a), float(b), float(r ** 3 / (a * b))],
+                       'density': layer['density']})
+    return Model({'angular_momentum': fine['angular_momentum'], 'layers': layers})
+
+
+def default_levels(num_layers):
+    """Layer counts doubling from 2 up to num_layers."""
+    levels = [2]
+    while levels[-1] * 2 < num_layers:
+        levels.append(levels[-1] * 2)
+    return [n for n in levels if n < num_layers] + [num_layers]
+
+
+def _refine_explorer(models, num_generations, num_variants, temperature):
+    solved = []
+    for model in models:
+        best, _ = model.anneal(num_generations, num_variants, temperature)
+        solved.append(Model({'angular_momentum': best['angular_momentum'],
+                             'layers': best['layers']}))
+    return solved
+
+
+def solve_multigrid(models, levels=None, method="newton", warm_start=True,
+                    num_generations=50, num_variants=65536, temperature=0.05,
+                    **newton_kwargs):
+    """
+    Solve models coarse-to-fine in layer count.
+
+    Args:
+        models: A Model or list of Models (the fine problems); a list is
+            refined as one batch at every level
+        levels: Layer counts to pass through (default: default_levels)
+        method: "newton" (solve_newton_krylov) or "explore" (Model.anneal,
+            at most 20 layers)
+        warm_start: Seed the coarsest level with seeding.seed_model
+        num_generations, num_variants, temperature: For method="explore"
+        newton_kwargs: Passed to solve_newton_krylov
+
+    Returns:
+        List of solved fine Models (a single Model if one was given)
+    """
+    single = isinstance(models, Model)
+    if single:
+        models = [models]
+
+    num_layers = max(len(m['layers']) for m in models)
+    if levels is None:
+        levels = default_levels(num_layers)
+
+    time_start = time.time()
+    current = None
+    for num in levels:
+        targets = [restrict(m, num) for m in models]
+        if current is None:
+            current = [seeding.seed_model(t) if warm_start else t for t in targets]
+        else:
+            current = [prolong(c, t) for c, t in zip(current, targets)]
+
+        level_start = time.time()
+        if method == "newton":
+            current, residuals, converged = solve_newton_krylov(current, **newton_kwargs)
+            detail = f"max residual {residuals.max():.3e}"
+        elif method == "explore":
+            current = _refine_explorer(current, num_generations, num_variants, temperature)
+            detail = ""
+        else:
+            raise ValueError(f"Unknown method {method!r}")
+
+        print(f"Level {num:3d} layers: {(time.time() - level_start):.3f} seconds {detail}")
+
+    print(f"Multigrid ({len(models)} models, levels {levels}): "
+          f"{(time.time() - time_start):.3f} seconds")
+
+    return current[0] if single else current
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    method = sys.argv[2] if len(sys.argv) > 2 else "newton"
+    solved = solve_multigrid(model, method=method)
+    print(json.dumps(solved, indent=4))
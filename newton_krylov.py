@@ -0,0 +1,267 @@
+# -*- coding: utf-8 -*-
+"""
+Matrix-free Newton-Krylov solver for many-layer equilibria.
+
+Unknowns are (log a_i, log b_i) for every layer; c_i follows from the
+layer's fixed volume. The residual is the pair (phi_a/phi_c - 1,
+phi_b/phi_c - 1) at each layer's axis tips, so the Jacobian is 2L x 2L
+and dense (every layer's potential depends on every other layer).
+
+The Jacobian is never formed. shader/newton_krylov.glsl.c evaluates F and
+the exact directional derivative J v with dual-number Carlson integrals,
+one workgroup per model, for a whole batch of models in one dispatch.
+GMRES runs on the host: each Arnoldi step is one batched J v dispatch,
+and the orthogonalization and small least-squares solves are numpy.
+
+Unlike the explorer's Model record, there is no 20-layer limit here.
+"""
+
+import time
+
+import numpy as np
+
+from compute_harness import ShaderConfig, BufferSpec, UniformSpec
+from Model import Model, harness
+
+
+_item_dtype = np.dtype([
+    ('angular_momentum', np.float64),      # offset 0
+    ('d_angular_momentum', np.float64),    # offset 8
+    ('num_layers', np.uint32),             # offset 16
+    ('layer_offset', np.uint32),           # offset 20
+    # Total: 24 bytes
+])
+
+_layer_dtype = np.dtype([
+    ('a', np.float64),                     # offset 0
+    ('b', np.float64),                     # offset 8
+    ('c', np.float64),                     # offset 16
+    ('density', np.float64),               # offset 24
+    ('dlog_a', np.float64),                # offset 32
+    ('dlog_b', np.float64),                # offset 40
+    # Total: 48 bytes
+])
+
+WORKGROUP_SIZE = 256
+
+
+def _get_program():
+    config = ShaderConfig.precision_config("double", "double")
+    return harness.get_program("shader/newton_krylov.glsl.c", config)
+
+
+class _Batch:
+    """Flat item/layer arrays for a list of models, plus per-model slices."""
+
+    def __init__(self, models):
+        self.models = models
+        counts = np.array([len(m['layers']) for m in models], dtype=np.uint32)
+        offsets = np.concatenate(([0], np.cumsum(counts)[:-1])).astype(np.uint32)
+        self.slices = [slice(2 * int(o), 2 * int(o + n)) for o, n in zip(offsets, counts)]
+
+        self.items = np.zeros(len(models), dtype=_item_dtype)
+        self.items['angular_momentum'] = [m['angular_momentum'] for m in models]
+        self.items['num_layers'] = counts
+        self.items['layer_offset'] = offsets
+
+        self.layers = np.zeros(int(counts.sum()), dtype=_layer_dtype)
+        layers = [layer for m in models for layer in m['layers']]
+        self.layers['density'] = [layer['density'] for layer in layers]
+        self.log_volume = np.log([np.prod(layer['abc']) for layer in layers])
+
+        # Unknowns, interleaved (log a, log b) per layer
+        self.x = np.log([layer['abc'][axis] for layer in layers for axis in (0, 1)])
+
+    def evaluate(self, x, v=None, angular_momentum=None, d_angular_momentum=None):
+        """
+        Residuals at x (all models), and J v when directions v are given.
+        Both are flat arrays laid out like x. angular_momentum and
+        d_angular_momentum (per model) override the models' L and add an
+        L component to the direction. The override applies to this call
+        only.
+        """
+        items = self.items.copy()
+        if angular_momentum is not None:
+            items['angular_momentum'] = angular_momentum
+        items['d_angular_momentum'] = 0.0 if d_angular_momentum is None else d_angular_momentum
+        log_a, log_b = x[0::2], x[1::2]
+        self.layers['a'] = np.exp(log_a)
+        self.layers['b'] = np.exp(log_b)
+        self.layers['c'] = np.exp(self.log_volume - log_a - log_b)
+        if v is None:
+            self.layers['dlog_a'] = 0.0
+            self.layers['dlog_b'] = 0.0
+        else:
+            self.layers['dlog_a'] = v[0::2]
+            self.layers['dlog_b'] = v[1::2]
+
+        num_items = len(items)
+        buffers = [
+            BufferSpec(binding=0, dtype=_item_dtype, count=num_items,
+                       mode="in", initial_data=items),
+            BufferSpec(binding=1, dtype=_layer_dtype, count=len(self.layers),
+                       mode="in", initial_data=self.layers),
+            BufferSpec(binding=2, dtype=np.dtype((np.float64, 4)), count=len(self.layers),
+                       mode="out"),
+        ]
+        uniforms = [UniformSpec("num_items", num_items, "1ui")]
+
+        out = _get_program().run(buffers, uniforms,
+                                 num_invocations=num_items * WORKGROUP_SIZE,
+                                 local_size_x=WORKGROUP_SIZE)[2]
+        out = out.reshape(-1, 4)
+        F = out[:, 0:2].ravel()
+        JV = out[:, 2:4].ravel()
+        return F, JV
+
+    def norms(self, F):
+        return np.array([np.linalg.norm(F[s]) for s in self.slices])
+
+    def to_models(self, x):
+        solved = []
+        for model, s in zip(self.models, self.slices):
+            log_a, log_b = x[s][0::2], x[s][1::2]
+            layers = []
+            for layer, la, lb in zip(model['layers'], log_a, log_b):
+                a, b = np.exp(la), np.exp(lb)
+                volume = np.prod(layer['abc'])
+                layers.append({
+                    'abc': [float(a), float(b), float(volume / (a * b))],
+                    'density': layer['density'],
+                })
+            solved.append(Model({
+                'angular_momentum': model['angular_momentum'],
+                'layers': layers,
+            }))
+        return solved
+
+
+def _gmres(batch, F, active, restart):
+    """
+    One GMRES(restart) cycle per active model for J dx = -F, with every
+    Arnoldi step sharing a single batched J v dispatch.
+    """
+    dx = np.zeros_like(batch.x)
+    m = restart
+    V, H, beta = {}, {}, {}
+
+    for i in active:
+        r0 = -F[batch.slices[i]]
+        beta[i] = np.linalg.norm(r0)
+        V[i] = [r0 / beta[i]]
+        H[i] = np.zeros((m + 1, m))
+
+    breakdown = set()
+    for j in range(m):
+        v = np.zeros_like(batch.x)
+        for i in active:
+            if i not in breakdown:
+                v[batch.slices[i]] = V[i][j]
+        _, JV = batch.evaluate(batch.x, v)
+
+        for i in active:
+            if i in breakdown:
+                continue
+            w = JV[batch.slices[i]]
+            # Modified Gram-Schmidt
+            for k in range(j + 1):
+                H[i][k, j] = np.dot(w, V[i][k])
+                w = w - H[i][k, j] * V[i][k]
+            H[i][j + 1, j] = np.linalg.norm(w)
+            if H[i][j + 1, j] <= 1e-14 * beta[i]:
+                breakdown.add(i)       # Krylov space is invariant; solution is exact
+            else:
+                V[i].append(w / H[i][j + 1, j])
+
+    for i in active:
+        # Columns of H filled: one per Arnoldi step taken
+        k = len(V[i]) if i in breakdown else len(V[i]) - 1
+        rhs = np.zeros(k + 1)
+        rhs[0] = beta[i]
+        y = np.linalg.lstsq(H[i][:k + 1, :k], rhs, rcond=None)[0]
+        dx[batch.slices[i]] = np.dot(y, np.array(V[i][:k]))
+
+    return dx
+
+
+def solve_newton_krylov(models, tolerance=1e-12, max_newton=30, restart=20,
+                        max_backtracks=8):
+    """
+    Solve a batch of models for equilibrium at fixed angular momentum,
+    volumes and densities.
+
+    Args:
+        models: List of Model, any number of layers each
+        tolerance: Convergence threshold on the residual 2-norm per model
+        max_newton: Newton iteration cap
+        restart: Krylov dimension (Arnoldi steps per Newton iteration)
+        max_backtracks: Step halvings allowed by the line search; a model
+            that fails all of them stops iterating (not converged)
+
+    Returns:
+        solved: List of solved Models
+        residuals: Final residual norm per model
+        converged: Boolean array
+    """
+    batch = _Batch(models)
+    time_start = time.time()
+
+    F, _ = batch.evaluate(batch.x)
+    norms = batch.norms(F)
+    # Models whose line search found no decrease: another Newton step from
+    # the same point would repeat the same solve, so they are dropped
+    stalled = np.zeros(len(models), dtype=bool)
+
+    for iteration in range(max_newton):
+        active = [i for i in range(len(models)) if norms[i] > tolerance and not stalled[i]]
+        if not active:
+            break
+
+        dx = _gmres(batch, F, active, restart)
+
+        # Backtracking line search on ||F||, per model
+        alpha = np.ones(len(models))
+        pending = list(active)
+        for _ in range(max_backtracks + 1):
+            trial = batch.x.copy()
+            for i in pending:
+                s = batch.slices[i]
+                trial[s] = batch.x[s] + alpha[i] * dx[s]
+            F_trial, _ = batch.evaluate(trial)
+            trial_norms = batch.norms(F_trial)
+
+            still_pending = []
+            for i in pending:
+                s = batch.slices[i]
+                if (np.isfinite(trial_norms[i])
+                        and trial_norms[i] <= (1 - 1e-4 * alpha[i]) * norms[i]):
+                    batch.x[s] = trial[s]
+                    F[s] = F_trial[s]
+                    norms[i] = trial_norms[i]
+                else:
+                    alpha[i] *= 0.5
+                    still_pending.append(i)
+            pending = still_pending
+            if not pending:
+                break
+        stalled[pending] = True
+
+        print(f"Newton {iteration + 1:3d}: {len(active)} active, "
+              f"max residual {norms.max():.3e}")
+
+    converged = norms <= tolerance
+    print(f"Newton-Krylov ({len(models)} models): {(time.time() - time_start):.3f} seconds, "
+          f"converged {converged.sum()}/{len(models)}, stalled {stalled.sum()}")
+
+    return batch.to_models(batch.x), norms, converged
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    solved, residuals, converged = solve_newton_krylov([model])
+    print(json.dumps(solved[0], indent=4))
@@ -0,0 +1,154 @@
+# -*- coding: utf-8 -*-
+"""
+Parallel tempering over layer shapes, all replicas in one dispatch.
+
+M replica chains run at geometrically spaced temperatures, one workgroup
+per chain (shader/parallel_tempering.glsl.c). Every dispatch advances each
+chain by `sweeps_per_exchange` multiple-try Metropolis steps (256 trial
+proposals and 255 reference proposals each, so every chain samples
+exp(-score / T) exactly) and then swaps neighbouring replicas with the
+usual exchange criterion, on the device. Hot chains move
+freely between basins and hand good states down to the cold chains, which
+helps near the Maclaurin/Jacobi bifurcation where a single temperature
+either over-explores or gets stuck.
+"""
+
+import random
+import time
+
+import numpy as np
+
+from compute_harness import ShaderConfig, BufferSpec, UniformSpec
+from Model import Model, harness
+
+
+class ParallelTempering:
+
+    MAX_REPLICAS = 64
+    PROPOSALS_PER_CHAIN = 256
+
+    _state_dtype = np.dtype([
+        ('workgroups_done', np.uint32),
+        ('exchange_round', np.uint32),
+        ('replica_temperature', np.float64, (MAX_REPLICAS,)),
+        ('replica_step', np.float64, (MAX_REPLICAS,)),
+        ('move_accepts', np.uint32, (MAX_REPLICAS,)),
+        ('swap_attempts', np.uint32, (MAX_REPLICAS,)),
+        ('swap_accepts', np.uint32, (MAX_REPLICAS,)),
+    ])
+
+    def __init__(self, model, num_replicas=32,
+                 min_temperature=1e-8, max_temperature=1e-2,
+                 min_step=0.01, max_step=1.0,
+                 sweeps_per_exchange=4, error_threshold=0.0, seed=None):
+        """
+        Args:
+            model: Starting Model for every replica
+            num_replicas: Number of chains M (at most MAX_REPLICAS)
+            min_temperature, max_temperature: Metropolis temperatures of the
+                coldest and hottest chain, in score units
+            min_step, max_step: Proposal spread of the coldest and hottest
+                chain, in the explorer's annealing_temperature units
+            sweeps_per_exchange: Sweeps per chain between replica exchanges
+            error_threshold: Passed through to compute_statistics
+            seed: Random seed (default: random)
+        """
+        if num_replicas > self.MAX_REPLICAS:
+            raise ValueError(f"num_replicas must be <= {self.MAX_REPLICAS}")
+
+        self.model = model
+        self.num_replicas = num_replicas
+        self.sweeps_per_exchange = sweeps_per_exchange
+        self.error_threshold = error_threshold
+        self.seed = random.randint(0, 0xFFFFFFFF) if seed is None else seed
+
+        ladder = np.linspace(0.0, 1.0, num_replicas)
+        self.temperatures = min_temperature * (max_temperature / min_temperature) ** ladder
+        self.steps = min_step * (max_step / min_step) ** ladder
+
+        config = ShaderConfig.precision_config("double", "double")
+        config.defines["PT_MAX_REPLICAS"] = self.MAX_REPLICAS
+        if error_threshold == 0.0:
+            # Error-only scoring: the kinetic-energy branch compiles out
+            config = config.fold(UniformSpec("error_threshold", 0.0, "1d"))
+        self.program = harness.get_program("shader/parallel_tempering.glsl.c", config)
+
+    def _initial_replicas(self):
+        record = np.frombuffer(self.model.to_struct() + b'\x00' * 8, dtype=Model._model_dtype)
+        replicas = np.repeat(record, self.num_replicas)
+        replicas['score'] = 1e30  # unscored: the first sweep almost surely moves off it
+        return replicas
+
+    def run(self, num_rounds):
+        """
+        Run num_rounds exchange rounds (num_rounds * sweeps_per_exchange
+        sweeps per chain).
+
+        Returns:
+            best_model: Best Model visited by any chain
+            stats: Dict of per-chain move acceptance and per-pair swap rates
+        """
+        M = self.num_replicas
+        replicas = self._initial_replicas()
+
+        state = np.zeros(1, dtype=self._state_dtype)
+        state['replica_temperature'][0, :M] = self.temperatures
+        state['replica_step'][0, :M] = self.steps
+
+        buffers = [
+            BufferSpec(binding=1, dtype=Model._model_dtype,
+                       count=M * self.PROPOSALS_PER_CHAIN, mode="device"),
+            BufferSpec(binding=2, dtype=Model._model_dtype, count=M,
+                       mode="out", initial_data=replicas),
+            BufferSpec(binding=3, dtype=Model._model_dtype, count=M,
+                       mode="out", initial_data=replicas.copy()),
+            BufferSpec(binding=4, dtype=self._state_dtype, count=1,
+                       mode="out", initial_data=state),
+        ]
+
+        time_start = time.time()
+
+        self.program.bind(buffers)
+        for round_idx in range(num_rounds):
+            round_seed = (self.seed + round_idx * 0x9E3779B9) & 0xFFFFFFFF
+            self.program.dispatch([
+                UniformSpec("num_replicas", M, "1ui"),
+                UniformSpec("sweeps_per_exchange", self.sweeps_per_exchange, "1ui"),
+                UniformSpec("seed", round_seed, "1ui"),
+                UniformSpec("error_threshold", self.error_threshold, "1d"),
+            ], M * self.PROPOSALS_PER_CHAIN)
+        results = self.program.read_back(buffers)
+        self.program.unbind(buffers)
+
+        print(f"Parallel tempering: {num_rounds} rounds x {self.sweeps_per_exchange} sweeps "
+              f"x {M} chains in {time.time() - time_start:.3f} seconds")
+
+        bests = results[3]
+        final_state = results[4][0]
+        best_slot = int(np.argmin(bests['score']))
+        best_model = Model.from_struct(bests[best_slot])
+
+        sweeps = num_rounds * self.sweeps_per_exchange
+        attempts = np.maximum(final_state['swap_attempts'][:M - 1], 1)
+        stats = {
+            'temperatures': self.temperatures,
+            'best_scores': bests['score'].copy(),
+            'move_acceptance': final_state['move_accepts'][:M] / max(sweeps, 1),
+            'swap_acceptance': final_state['swap_accepts'][:M - 1] / attempts,
+        }
+
+        print(f"Best score: {bests['score'][best_slot]:.6e} (temperature slot {best_slot})")
+        print(f"Swap acceptance: {np.array2string(stats['swap_acceptance'], precision=2)}")
+
+        return best_model, stats
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    best, stats = ParallelTempering(model).run(200)
+    print(json.dumps(best, indent=4))
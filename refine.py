@@ -0,0 +1,141 @@
+# -*- coding: utf-8 -*-
+"""
+Local refinement of explorer candidates on a CPU worker pool, overlapped
+with the GPU.
+
+Each generation's top candidates are polished with Nelder-Mead on the
+host (scored by host_variation.compute_statistics) while the GPU runs the
+next generations. A refined model that beats the current template becomes
+the template of the next generation it is ready for.
+
+The search is over (log a, log b) of every layer; c follows from the
+layer's volume, which is fixed.
+"""
+
+import time
+from concurrent.futures import ThreadPoolExecutor, wait
+
+import numpy as np
+from scipy.optimize import minimize
+
+from Model import Model
+from model_batch import ModelBatch
+from host_variation import compute_statistics
+
+
+def _template(model):
+    """Bare Model (geometry only) from a result dict."""
+    return Model({'angular_momentum': model['angular_momentum'],
+                  'layers': [{'abc': list(layer['abc']), 'density': layer['density']}
+                             for layer in model['layers']]})
+
+
+def refine_model(model, max_evaluations=2000, tolerance=1e-14):
+    """
+    Nelder-Mead on rel_equipotential_err in (log a, log b) per layer.
+
+    Returns:
+        The refined model, scored (a dict, as Model.from_struct)
+    """
+    record = ModelBatch.from_models([_template(model)]).records
+    num_layers = int(record['num_layers'][0])
+    layers = record['layers'][0, :num_layers]
+    volume = layers['a'] * layers['b'] * layers['c']
+
+    def set_axes(x):
+        a = np.exp(x[:num_layers])
+        b = np.exp(x[num_layers:])
+        layers['a'], layers['b'], layers['c'] = a, b, volume / (a * b)
+
+    def objective(x):
+        set_axes(x)
+        compute_statistics(record)
+        return float(record['rel_equipotential_err'][0])
+
+    x0 = np.log(np.concatenate((layers['a'], layers['b'])))
+    result = minimize(objective, x0, method='Nelder-Mead',
+                      options={'maxfev': max_evaluations, 'xatol': tolerance,
+                               'fatol': tolerance, 'adaptive': True})
+    objective(result.x)
+    return Model.from_struct(record[0])
+
+
+def refine_models(models, num_workers=4, **kwargs):
+    """refine_model over a list, on a thread pool."""
+    with ThreadPoolExecutor(max_workers=num_workers) as pool:
+        return list(pool.map(lambda m: refine_model(m, **kwargs), models))
+
+
+def pipelined_search(model, num_generations, num_variants, temperature,
+                     top_k=8, num_workers=4, seed=None, **refine_kwargs):
+    """
+    Explorer generations on the GPU with CPU refinement in the background.
+
+    Generation g's top_k candidates go to the worker pool as soon as they
+    are read back, and generation g + 1 is dispatched right away. Before
+    each dispatch, finished refinements are collected (without waiting);
+    the best one replaces the template if it beats it.
+
+    Args:
+        model: Starting template
+        num_generations, num_variants, temperature: Explorer parameters
+        top_k: Candidates refined per generation
+        num_workers: CPU refinement threads
+        seed: Base seed (default: random per generation)
+        refine_kwargs: Passed to refine_model
+
+    Returns:
+        best: Best model found (GPU or refined)
+        history: Per generation, (GPU best score, template score)
+    """
+    template = _template(model)
+    best = None
+    pending = []
+    history = []
+
+    def consider(candidate):
+        nonlocal best
+        if best is None or candidate['rel_equipotential_err'] < best['rel_equipotential_err']:
+            best = candidate
+            return True
+        return False
+
+    time_start = time.time()
+    with ThreadPoolExecutor(max_workers=num_workers) as pool:
+        for generation in range(num_generations):
+            # Fold in whatever refinement has finished
+            # (one snapshot, so a future finishing meanwhile is kept in pending)
+            done, _ = wait(pending, timeout=0)
+            improved = [consider(f.result()) for f in pending if f in done]
+            pending = [f for f in pending if f not in done]
+            if any(improved):
+                template = _template(best)
+
+            gen_seed = None if seed is None else (seed + generation * 0x9E3779B9) & 0xFFFFFFFF
+            gpu_best, top_models = template.explore_variations(
+                num_variants, temperature, top_k=top_k, seed=gen_seed)
+            if consider(gpu_best):
+                template = _template(best)
+
+            pending += [pool.submit(refine_model, m, **refine_kwargs) for m in top_models]
+            history.append((gpu_best['rel_equipotential_err'], best['rel_equipotential_err']))
+
+        for f in pending:
+            consider(f.result())
+
+    print(f"Pipelined search ({num_generations} generations, {num_workers} workers): "
+          f"{(time.time() - time_start):.3f} seconds, "
+          f"best rel_equipotential_err {best['rel_equipotential_err']:.3e}")
+    return best, history
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    best, history = pipelined_search(model, num_generations=20, num_variants=100000,
+                                     temperature=0.1)
+    print(json.dumps(best, indent=4))
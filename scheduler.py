@@ -0,0 +1,163 @@
+# -*- coding: utf-8 -*-
+"""
+Many concurrent explorer searches sharing one GL context.
+
+Model.explore_variations runs its stages back to back and blocks in
+glFinish, so while one search sorts and converts its results the GPU sits
+idle. Here every search is an asyncio coroutine and each stage awaits
+something:
+
+    submit     bind buffers, set uniforms, dispatch   (event loop thread)
+    GPU        await a fence, polled without blocking
+    read back  (score, idx) pairs only (SCORE_INDEX)
+    host       regenerate and re-score the winners    (thread pool)
+
+While one search waits on its fence or its host stage, others submit, so
+the queue stays full. All GL calls are made from the event loop thread,
+which must be the thread that owns the context (the one that imported
+Model). Each in-flight dispatch uses its own program instance, so its
+buffers are not shared with the others.
+
+    scheduler = SearchScheduler()
+    results = scheduler.run([scheduler.search(m, 20, 100000, 0.1) for m in models])
+"""
+
+import asyncio
+import random
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+from compute_harness import BufferSpec, UniformSpec
+from Model import Model, harness
+from host_variation import regenerate_winners
+
+
+class SearchScheduler:
+
+    def __init__(self, max_in_flight=4, num_workers=4, poll_interval=2e-4):
+        """
+        Args:
+            max_in_flight: Dispatches queued on the GPU at once (each holds
+                a program instance and its buffers)
+            num_workers: Threads for the host stages
+            poll_interval: Seconds between fence polls
+        """
+        self.max_in_flight = max_in_flight
+        self.poll_interval = poll_interval
+        self._executor = ThreadPoolExecutor(max_workers=num_workers)
+        self._instances = None
+
+    async def _wait_gpu(self):
+        """Yield to other searches until the work issued so far is done."""
+        sync = harness.insert_fence()
+        try:
+            while not harness.fence_signaled(sync):
+                await asyncio.sleep(self.poll_interval)
+        finally:
+            harness.delete_fence(sync)
+
+    async def explore(self, model, num_variants, temperature, top_k=1, seed=None):
+        """
+        One explorer dispatch, scored by rel_equipotential_err.
+
+        Returns:
+            best_model, top_models: As Model.explore_variations
+        """
+        if self._instances is None:
+            self._instances = asyncio.Queue()
+            for instance in range(self.max_in_flight):
+                self._instances.put_nowait(instance)
+        if seed is None:
+            seed = random.randint(0, 0xFFFFFFFF)
+
+        constants = Model._dispatch_constants(temperature, 0.0)
+
+        num_workgroups = (num_variants + 255) // 256
+        input_array = np.frombuffer(model.to_struct(), dtype=np.uint8)
+        buffers = [
+            BufferSpec(binding=0, dtype=np.uint8, count=len(input_array),
+                       mode="in", initial_data=input_array),
+            BufferSpec(binding=1, dtype=Model._model_dtype, count=num_variants,
+                       mode="device"),
+            BufferSpec(binding=2, dtype=Model._model_dtype, count=num_workgroups,
+                       mode="device"),
+            BufferSpec(binding=3, dtype=np.float64, count=num_workgroups,
+                       mode="device"),
+            BufferSpec(binding=12, dtype=Model._score_index_dtype, count=num_variants,
+                       mode="out"),
+        ]
+        uniforms = [
+            UniformSpec("num_variations", num_variants, "1ui"),
+            UniformSpec("seed", seed, "1ui"),
+            UniformSpec("annealing_temperature", temperature, "1d"),
+        ]
+
+        instance = await self._instances.get()
+        try:
+            program = model._get_program(constants, instance=instance, SCORE_INDEX=1)
+            # No await between bind and dispatch: the bindings are global
+            # context state
+            program.bind(buffers)
+            program.dispatch(uniforms, num_variants)
+            program.unbind(buffers)
+
+            await self._wait_gpu()
+            pairs = program.read_back(buffers, wait=False)[12]
+        finally:
+            self._instances.put_nowait(instance)
+
+        loop = asyncio.get_running_loop()
+        records, _ = await loop.run_in_executor(
+            self._executor, regenerate_winners, model, pairs, top_k, seed, temperature)
+        top_models = [Model.from_struct(r) for r in records]
+        return top_models[0], top_models
+
+    async def search(self, model, num_generations, num_variants, temperature, seed=None):
+        """
+        Greedy multi-generation search: each generation's best becomes the
+        next template, and the temperature halves when a generation fails
+        to improve.
+
+        Returns:
+            best: Best model found
+        """
+        template = model
+        best = None
+        for generation in range(num_generations):
+            gen_seed = None if seed is None else (seed + generation * 0x9E3779B9) & 0xFFFFFFFF
+            candidate, _ = await self.explore(template, num_variants, temperature, seed=gen_seed)
+            if best is None or candidate['rel_equipotential_err'] < best['rel_equipotential_err']:
+                best = candidate
+                template = Model({'angular_momentum': best['angular_momentum'],
+                                  'layers': best['layers']})
+            else:
+                temperature *= 0.5
+        return best
+
+    def run(self, coroutines):
+        """Run coroutines (e.g. search()es) to completion, results in order."""
+        async def gather():
+            return await asyncio.gather(*coroutines)
+
+        time_start = time.time()
+        self._instances = None  # queues belong to one event loop
+        results = asyncio.run(gather())
+        print(f"Scheduler: {len(results)} tasks in {(time.time() - time_start):.3f} seconds")
+        return results
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    models = []
+    for filename in sys.argv[1:]:
+        with open(filename, 'r') as fp:
+            models.append(Model(json.load(fp)))
+
+    scheduler = SearchScheduler()
+    bests = scheduler.run([scheduler.search(m, 20, 100000, 0.5) for m in models])
+    for filename, best in zip(sys.argv[1:], bests):
+        print(f"{filename}: rel_equipotential_err {best['rel_equipotential_err']:.3e}")
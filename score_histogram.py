@@ -0,0 +1,110 @@
+# -*- coding: utf-8 -*-
+"""
+Log-scale histograms of explorer scores, built on the GPU.
+
+The explorer (compiled with SCORE_HISTOGRAM) bins every variation's `score`
+and `rel_equipotential_err` into log10-spaced bins in shared memory and
+merges them into one global histogram with atomics. Reading back 2 x BINS
+counters is enough to estimate quantiles of the whole distribution, which
+is what error_threshold="auto" uses to pick the next threshold.
+"""
+
+import numpy as np
+
+
+class ScoreHistogram:
+
+    # Bin layout; injected into the shader through defines() so the two sides
+    # can't disagree. 4 bins per decade from 1e-16 to 1e32 (the 1e30 penalty
+    # score lands in its own bin near the top).
+    LOG10_MIN = -16
+    LOG10_MAX = 32
+    BINS = 192
+
+    _dtype = np.dtype([
+        ('score', np.uint32, (BINS,)),
+        ('rel_equipotential_err', np.uint32, (BINS,)),
+    ])
+
+    def __init__(self, score_counts=None, err_counts=None):
+        self.counts = {
+            'score': np.zeros(self.BINS, dtype=np.int64) if score_counts is None
+                     else np.asarray(score_counts, dtype=np.int64),
+            'rel_equipotential_err': np.zeros(self.BINS, dtype=np.int64) if err_counts is None
+                                     else np.asarray(err_counts, dtype=np.int64),
+        }
+
+    @classmethod
+    def defines(cls):
+        """Shader defines for the histogram variant of the explorer."""
+        return {
+            'SCORE_HISTOGRAM': 1,
+            'HIST_BINS': cls.BINS,
+            'HIST_LOG10_MIN': f'({cls.LOG10_MIN})',
+            'HIST_LOG10_MAX': f'({cls.LOG10_MAX})',
+        }
+
+    @classmethod
+    def from_struct(cls, s):
+        """Build from the raw ScoreHistogram SSBO contents."""
+        return cls(s['score'], s['rel_equipotential_err'])
+
+    @classmethod
+    def bin_edges(cls):
+        return np.logspace(cls.LOG10_MIN, cls.LOG10_MAX, cls.BINS + 1)
+
+    @property
+    def total(self):
+        return int(self.counts['score'].sum())
+
+    def merge(self, other):
+        """Accumulate another histogram (e.g. from a later generation)."""
+        for field in self.counts:
+            self.counts[field] = self.counts[field] + other.counts[field]
+        return self
+
+    def quantile(self, q, field='rel_equipotential_err'):
+        """
+        Estimate the q-quantile of `field`, interpolating log-linearly
+        within the bin that contains it.
+        """
+        counts = self.counts[field]
+        total = counts.sum()
+        if total == 0:
+            return np.nan
+
+        cumulative = np.cumsum(counts)
+        target = q * total
+        bin_idx = int(np.searchsorted(cumulative, target, side='right'))
+        bin_idx = min(bin_idx, self.BINS - 1)
+
+        below = cumulative[bin_idx] - counts[bin_idx]
+        frac = (target - below) / counts[bin_idx] if counts[bin_idx] else 0.0
+
+        width = (self.LOG10_MAX - self.LOG10_MIN) / self.BINS
+        return 10.0 ** (self.LOG10_MIN + (bin_idx + frac) * width)
+
+    def fraction_below(self, value, field='rel_equipotential_err'):
+        """Estimated fraction of samples with `field` below `value`."""
+        counts = self.counts[field]
+        total = counts.sum()
+        if total == 0:
+            return np.nan
+
+        width = (self.LOG10_MAX - self.LOG10_MIN) / self.BINS
+        pos = (np.log10(value) - self.LOG10_MIN) / width
+        pos = np.clip(pos, 0, self.BINS)
+        whole = int(pos)
+        partial = counts[whole] * (pos - whole) if whole < self.BINS else 0
+        return (counts[:whole].sum() + partial) / total
+
+    def suggest_error_threshold(self, hit_fraction):
+        """
+        Error threshold that roughly `hit_fraction` of variations would pass
+        at the same temperature.
+        """
+        return self.quantile(hit_fraction, 'rel_equipotential_err')
+
+    def summary(self, field='score', quantiles=(0.0001, 0.001, 0.01, 0.1, 0.5)):
+        parts = [f"q{q:g}={self.quantile(q, field):.3e}" for q in quantiles]
+        return f"{field} ({self.total} samples): " + ", ".join(parts)
@@ -0,0 +1,244 @@
+# -*- coding: utf-8 -*-
+"""
+Analytic Maclaurin/Jacobi warm starts for explorer templates.
+
+A layered model is replaced by the homogeneous body with the same total
+mass, outer volume and angular momentum. Its exact equilibrium (Maclaurin
+spheroid below the bifurcation, Jacobi ellipsoid above it) gives axis
+ratios, which are applied to every layer at the layer's own volume.
+
+Everything is vectorized over angular momentum. The equilibrium conditions
+use the shader's conventions (Phi = pi rho (I - A x^2), with
+A_x = (2/3) abc R_D(b^2, c^2, a^2)). In units of unit volume (abc = 1) and
+unit density:
+
+    Maclaurin (a = b):  omega^2 = 2 pi (A_1 a^2 - A_3 c^2) / a^2
+    Jacobi:             omega^2 = 2 pi (A_1 a^2 - A_2 b^2) / (a^2 - b^2)
+                        a^2 b^2 (A_1 - A_2) / (a^2 - b^2) = A_3 c^2 / (abc)
+
+and L = omega I with I = (4/15) pi abc (a^2 + b^2). A body with density
+rho and volume radius r scales as L ~ rho^(3/2) r^5.
+"""
+
+import numpy as np
+from scipy.special import elliprd
+
+from Model import Model
+
+
+# Bisection steps; each halves the bracket, so 60 reaches double precision
+_BISECT_STEPS = 60
+
+
+def _bisect(f, lo, hi):
+    """Vectorized bisection for a root of f in [lo, hi] (elementwise)."""
+    lo = np.array(lo, dtype=np.float64)
+    hi = np.array(hi, dtype=np.float64)
+    f_lo = f(lo)
+    for _ in range(_BISECT_STEPS):
+        mid = 0.5 * (lo + hi)
+        f_mid = f(mid)
+        same = np.sign(f_mid) == np.sign(f_lo)
+        lo = np.where(same, mid, lo)
+        f_lo = np.where(same, f_mid, f_lo)
+        hi = np.where(same, hi, mid)
+    return 0.5 * (lo + hi)
+
+
+def _index_coefficients(a, b, c):
+    """(2/3) abc R_D terms A_1, A_2, A_3 (per unit abc: abc = 1 here)."""
+    a2, b2, c2 = a * a, b * b, c * c
+    abc = a * b * c
+    A1 = (2.0 / 3.0) * abc * elliprd(b2, c2, a2)
+    A2 = (2.0 / 3.0) * abc * elliprd(a2, c2, b2)
+    A3 = (2.0 / 3.0) * abc * elliprd(a2, b2, c2)
+    return A1, A2, A3
+
+
+def _angular_momentum(a, b, c, omega2):
+    moi = (4.0 / 15.0) * np.pi * a * b * c * (a * a + b * b)
+    return moi * np.sqrt(np.maximum(omega2, 0.0))
+
+
+# ----------------------------------------------------------------------------
+# Maclaurin spheroids, parametrized by eccentricity e (c/a = sqrt(1 - e^2))
+# ----------------------------------------------------------------------------
+
+def maclaurin(e):
+    """Axes (a, a, c) at unit volume, omega^2 and L for eccentricity e."""
+    e = np.asarray(e, dtype=np.float64)
+    q = np.sqrt(1.0 - e * e)
+    a = q ** (-1.0 / 3.0)
+    c = q * a
+    A1, _, A3 = _index_coefficients(a, a, c)
+    omega2 = 2.0 * np.pi * (A1 * a * a - A3 * c * c) / (a * a)
+    return (a, a, c), omega2, _angular_momentum(a, a, c, omega2)
+
+
+# ----------------------------------------------------------------------------
+# Jacobi ellipsoids, parametrized by a (with abc = 1, a >= b >= c)
+# ----------------------------------------------------------------------------
+
+def _jacobi_residual(a, b):
+    """Vectorized version of generate_jacobi_test_case.jacobi_residual."""
+    c = 1.0 / (a * b)
+    a2, b2, c2 = a * a, b * b, c * c
+    rja = elliprd(b2, c2, a2)
+    rjb = elliprd(a2, c2, b2)
+    rjc = elliprd(a2, b2, c2)
+    return (a2 * b2) / (b2 - a2) * (rja - rjb) - c2 * rjc
+
+
+def jacobi(a):
+    """Axes (a, b, c) at unit volume, omega^2 and L on the Jacobi sequence."""
+    a = np.asarray(a, dtype=np.float64)
+    # Same bracket as generate_jacobi_test_case: b between c and a
+    eps = 1e-12
+    b = _bisect(lambda b: _jacobi_residual(a, b), np.sqrt(1.0 / a) * (1 + eps), a * (1 - eps))
+    c = 1.0 / (a * b)
+    A1, A2, _ = _index_coefficients(a, b, c)
+    omega2 = 2.0 * np.pi * (A1 * a * a - A2 * b * b) / (a * a - b * b)
+    return (a, b, c), omega2, _angular_momentum(a, b, c, omega2)
+
+
+# The Maclaurin -> Jacobi bifurcation (e = 0.812670...)
+BIFURCATION_ECCENTRICITY = 0.8126700
+_, _, BIFURCATION_L = maclaurin(BIFURCATION_ECCENTRICITY)
+_BIFURCATION_A = float(maclaurin(BIFURCATION_ECCENTRICITY)[0][0])
+
+
+def equilibrium_shapes(angular_momentum, branch="auto"):
+    """
+    Unit-volume, unit-density equilibrium axes for an array of angular
+    momenta.
+
+    Args:
+        angular_momentum: Array of L (dimensionless, see module docstring)
+        branch: "maclaurin", "jacobi", or "auto" (Jacobi past the
+            bifurcation, where it is the lower-energy branch)
+
+    Returns:
+        a, b, c: Arrays of semi-axes (a >= b >= c, abc = 1)
+        omega2: Array of squared rotation rates
+    """
+    L = np.atleast_1d(np.asarray(angular_momentum, dtype=np.float64))
+    use_jacobi = np.zeros(L.shape, dtype=bool)
+    if branch == "jacobi":
+        use_jacobi[:] = True
+    elif branch == "auto":
+        use_jacobi = L > BIFURCATION_L
+    elif branch != "maclaurin":
+        raise ValueError(f"Unknown branch {branch!r}")
+
+    a = np.ones_like(L)
+    b = np.ones_like(L)
+    c = np.ones_like(L)
+    omega2 = np.zeros_like(L)
+
+    # L grows monotonically along both sequences, so bisect in the sequence
+    # parameter. (Jacobi L below the bifurcation value has no solution; those
+    # entries end up at the bifurcation point.)
+    m = ~use_jacobi & (L > 0)
+    if m.any():
+        e = _bisect(lambda e: maclaurin(e)[2] - L[m], np.zeros(m.sum()),
+                    np.full(m.sum(), 1.0 - 1e-12))
+        (a[m], b[m], c[m]), omega2[m], _ = maclaurin(e)
+
+    j = use_jacobi
+    if j.any():
+        a_j = _bisect(lambda x: jacobi(x)[2] - L[j],
+                      np.full(j.sum(), _BIFURCATION_A * (1 + 1e-6)),
+                      np.full(j.sum(), 1e3))
+        (a[j], b[j], c[j]), omega2[j], _ = jacobi(a_j)
+
+    return a, b, c, omega2
+
+
+def _homogeneous_equivalent(model):
+    """(outer volume radius, mean density) of the layered model."""
+    r = np.array([np.cbrt(np.prod(layer['abc'])) for layer in model['layers']])
+    density = np.array([layer['density'] for layer in model['layers']])
+    r_out = r.max()
+    # Layer densities are superposed increments, so mass ~ sum(rho_i r_i^3)
+    mean_density = np.sum(density * r ** 3) / r_out ** 3
+    return r_out, mean_density
+
+
+def seed_models(model, angular_momenta=None, branch="auto"):
+    """
+    Warm-start templates for `model` at each angular momentum.
+
+    Args:
+        model: Template Model (its layer volumes and densities are kept)
+        angular_momenta: Array of L (default: the model's own)
+        branch: As in equilibrium_shapes
+
+    Returns:
+        List of Models, one per angular momentum
+    """
+    if angular_momenta is None:
+        angular_momenta = [model['angular_momentum']]
+    angular_momenta = np.atleast_1d(np.asarray(angular_momenta, dtype=np.float64))
+
+    r_out, mean_density = _homogeneous_equivalent(model)
+    L_unit = mean_density ** 1.5 * r_out ** 5
+    a, b, c, _ = equilibrium_shapes(angular_momenta / L_unit, branch)
+
+    seeded = []
+    for L, sa, sb, sc in zip(angular_momenta, a, b, c):
+        layers = []
+        for layer in model['layers']:
+            r = np.cbrt(np.prod(layer['abc']))
+            layers.append({
+                'abc': [float(r * sa), float(r * sb), float(r * sc)],
+                'density': layer['density'],
+            })
+        seeded.append(Model({'angular_momentum': float(L), 'layers': layers}))
+    return seeded
+
+
+def seed_model(model, branch="auto"):
+    """Warm-start template for `model` at its own angular momentum."""
+    return seed_models(model, branch=branch)[0]
+
+
+def generations_to_converge(model, target_err, num_variants=100000, temperature=0.1,
+                            max_generations=200, seed=None):
+    """
+    Number of explorer generations (best of each becomes the next
+    template, at a temperature that halves whenever a generation fails to
+    improve) until rel_equipotential_err drops below target_err.
+    Returns max_generations + 1 if it never does.
+    """
+    template = model
+    best_err = np.inf
+    for generation in range(1, max_generations + 1):
+        gen_seed = None if seed is None else (seed + generation * 0x9E3779B9) & 0xFFFFFFFF
+        best, _ = template.explore_variations(num_variants, temperature, seed=gen_seed)
+        if best['rel_equipotential_err'] < best_err:
+            best_err = best['rel_equipotential_err']
+            template = Model({'angular_momentum': best['angular_momentum'],
+                              'layers': best['layers']})
+        else:
+            temperature *= 0.5
+        if best_err < target_err:
+            return generation
+    return max_generations + 1
+
+
+if __name__ == '__main__':
+    import json
+    import sys
+
+    with open(sys.argv[1], 'r') as fp:
+        model = Model(json.load(fp))
+
+    seeded = seed_model(model)
+    print(json.dumps(seeded, indent=4))
+
+    # How much does the warm start save?
+    target = float(sys.argv[2]) if len(sys.argv) > 2 else 1e-8
+    cold = generations_to_converge(model, target, seed=1234)
+    warm = generations_to_converge(seeded, target, seed=1234)
+    print(f"Generations to rel_equipotential_err < {target:g}: "
+          f"cold start {cold}, warm start {warm}")
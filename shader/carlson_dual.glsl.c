@@ -0,0 +1,101 @@
+// carlson_dual.glsl.c
+// Dual-number versions of carlson_rf and carlson_rd (same duplication
+// steps and series as carlson.glsl.c), giving the value and the exact
+// directional derivative in one pass. Arguments must be positive.
+
+#ifndef CARLSON_DUAL_GLSL_C
+#define CARLSON_DUAL_GLSL_C
+
+#include "shader/precision.glsl.c"
+#include "shader/dual.glsl.c"
+
+//========================================================================
+
+DUAL carlson_rf_dual(DUAL x, DUAL y, DUAL z)
+{
+    DUAL xt = x;
+    DUAL yt = y;
+    DUAL zt = z;
+
+    for (int i = 0; i < ITER; ++i) {
+        DUAL sx = dual_sqrt(xt);
+        DUAL sy = dual_sqrt(yt);
+        DUAL sz = dual_sqrt(zt);
+        DUAL lam = dual_mul(sx, sy) + dual_mul(sy, sz) + dual_mul(sz, sx);
+        xt = R(0.25LF) * (xt + lam);
+        yt = R(0.25LF) * (yt + lam);
+        zt = R(0.25LF) * (zt + lam);
+    }
+
+    // Mean and reduced variables
+    DUAL A = (xt + yt + zt) / R(3.LF);
+    DUAL X = dual_const(R(1.LF)) - dual_div(xt, A);
+    DUAL Y = dual_const(R(1.LF)) - dual_div(yt, A);
+    DUAL Z = dual_const(R(1.LF)) - dual_div(zt, A);
+
+    // Elementary symmetric polynomials
+    DUAL e2 = dual_mul(X, Y) + dual_mul(Y, Z) + dual_mul(Z, X);
+    DUAL e3 = dual_mul(dual_mul(X, Y), Z);
+
+    DUAL poly = 
+                 dual_const(R(1.LF))
+               - R(0.1LF) * e2
+               + R(1.LF/24.LF) * e3
+               + R(3.LF/44.LF) * dual_mul(e2, e2)
+               - R(1.LF/14.LF) * dual_mul(e2, e3)
+               + R(1.LF/24.LF) * dual_mul(e3, e3);
+
+    return dual_mul(dual_inversesqrt(A), poly);
+}
+
+//========================================================================
+
+DUAL carlson_rd_dual(DUAL x, DUAL y, DUAL z)
+{
+    DUAL xt = x;
+    DUAL yt = y;
+    DUAL zt = z;
+
+    DUAL sum = dual_const(R(0.LF));
+    CALC_REAL fac = R(1.LF);
+
+    for (int i = 0; i < ITER; ++i) {
+        DUAL sx = dual_sqrt(xt);
+        DUAL sy = dual_sqrt(yt);
+        DUAL sz = dual_sqrt(zt);
+        DUAL lam = dual_mul(sx, sy + sz) + dual_mul(sy, sz);
+
+        sum += fac * dual_div(dual_const(R(1.LF)), dual_mul(sz, zt + lam));
+
+        fac *= R(0.25LF);
+        xt = R(0.25LF) * (xt + lam);
+        yt = R(0.25LF) * (yt + lam);
+        zt = R(0.25LF) * (zt + lam);
+    }
+
+    DUAL A    = R(0.2LF) * (xt + yt + R(3.LF) * zt);
+    DUAL delx = dual_div(A - xt, A);
+    DUAL dely = dual_div(A - yt, A);
+    DUAL delz = dual_div(A - zt, A);
+
+    DUAL ea = dual_mul(delx, dely);
+    DUAL eb = dual_mul(delz, delz);
+    DUAL ec = ea - eb;
+    DUAL ed = ea - R(6.LF) * eb;
+    DUAL ee = ed + R(2.LF) * ec;
+
+    DUAL series = dual_const(R(1.LF))
+                + dual_mul(ed,
+                      dual_const(-R(3.LF/14.LF))
+                    + R(9.LF/88.LF) * ed
+                    - R(9.LF/78.LF) * dual_mul(delz, ee))
+                + dual_mul(delz,
+                      R(1.LF/6.LF) * ee
+                    + dual_mul(delz, -R(9.LF/22.LF) * ec
+                                   + R(3.LF/26.LF) * dual_mul(delz, ea)));
+
+    return R(3.LF) * sum + fac * dual_div(series, dual_mul(A, dual_sqrt(A)));
+}
+
+//========================================================================
+#endif
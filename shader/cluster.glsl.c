@@ -0,0 +1,145 @@
+#version 460 core
+#extension GL_ARB_gpu_shader_fp64 : require
+
+#include "shader/precision.glsl.c"
+#include "shader/model.glsl.c"
+
+// Canonicalize and de-duplicate a score-sorted list of candidates.
+//
+// Canonical form: a model and its copy rotated by 90 degrees about the
+// spin (c) axis are the same solution with every layer's a and b swapped.
+// Each candidate is flipped, if needed, so that its outermost layer has
+// a >= b. (Swapping layers independently would describe a different
+// configuration, so the flip is all-or-nothing.)
+//
+// Clustering is greedy in score order: a candidate becomes the
+// representative of a new cluster unless it lies within
+// distance_threshold of an earlier representative, in which case it joins
+// that representative's cluster. Distance is the largest difference of
+// log a or log b over the layers (c follows from the layer volume).
+// Candidates are visited in order by the single workgroup; each visit
+// checks the earlier representatives in parallel.
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+// Candidates, best first (canonicalized in place)
+// (coherent: every invocation reads candidates other invocations flipped)
+layout(std430, binding = 1) coherent buffer Candidates {
+    Model candidates[];
+};
+
+// Per candidate: index of its cluster's representative (itself if it is one)
+layout(std430, binding = 2) buffer ClusterOf {
+    uint cluster_of[];
+};
+
+// Representatives in score order
+// (coherent: thread 0 appends, every invocation reads the list)
+layout(std430, binding = 3) coherent buffer Clusters {
+    uint num_clusters;
+    uint representatives[];
+};
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint num_candidates;
+uniform float distance_threshold;  // in log-axis units
+uniform uint max_clusters;         // stop once this many are found
+
+// ============================================================================
+// Shared memory
+// ============================================================================
+
+shared uint local_nearest;
+shared uint local_count;
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+float model_distance(uint i, uint j)
+{
+    float d = 0.0;
+    for (uint k = 0u; k < candidates[i].num_layers; k++) {
+        d = max(d, abs(log(float(candidates[i].layers[k].a / candidates[j].layers[k].a))));
+        d = max(d, abs(log(float(candidates[i].layers[k].b / candidates[j].layers[k].b))));
+    }
+    return d;
+}
+
+// ============================================================================
+// Main Compute Shader
+// ============================================================================
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint local_idx = gl_LocalInvocationID.x;
+
+    // ========================================================================
+    // CANONICALIZE
+    // ========================================================================
+
+    for (uint i = local_idx; i < num_candidates; i += gl_WorkGroupSize.x) {
+        uint outer = candidates[i].num_layers - 1u;
+        if (candidates[i].layers[outer].b > candidates[i].layers[outer].a) {
+            for (uint k = 0u; k < candidates[i].num_layers; k++) {
+                BUFF_REAL a = candidates[i].layers[k].a;
+                candidates[i].layers[k].a = candidates[i].layers[k].b;
+                candidates[i].layers[k].b = a;
+            }
+        }
+    }
+
+    if (local_idx == 0u) {
+        local_count = 0u;
+    }
+    memoryBarrierBuffer();
+    barrier();
+
+    // ========================================================================
+    // GREEDY CLUSTERING IN SCORE ORDER
+    // ========================================================================
+
+    for (uint i = 0u; i < num_candidates; i++) {
+        if (local_idx == 0u) {
+            local_nearest = 0xFFFFFFFFu;
+        }
+        memoryBarrierBuffer();
+        barrier();
+
+        uint count = local_count;
+        if (count >= max_clusters) {
+            break;  // uniform: every invocation read the same count
+        }
+
+        // Earliest (best) representative within the threshold
+        for (uint r = local_idx; r < count; r += gl_WorkGroupSize.x) {
+            if (model_distance(i, representatives[r]) < distance_threshold) {
+                atomicMin(local_nearest, r);
+            }
+        }
+        memoryBarrierBuffer();
+        barrier();
+
+        if (local_idx == 0u) {
+            if (local_nearest == 0xFFFFFFFFu) {
+                representatives[count] = i;
+                cluster_of[i] = i;
+                local_count = count + 1u;
+            } else {
+                cluster_of[i] = representatives[local_nearest];
+            }
+        }
+        memoryBarrierBuffer();
+        barrier();
+    }
+
+    if (local_idx == 0u) {
+        num_clusters = local_count;
+    }
+}
@@ -0,0 +1,61 @@
+// cmaes.glsl.c
+// Buffers and uniforms shared by the two CMA-ES stages:
+//   cmaes_sample.glsl.c     - draw lambda offspring and score them
+//   cmaes_recombine.glsl.c  - rank them and form the weighted sums
+// The stages run back to back against the same bound buffers; the rest of
+// the CMA-ES update (evolution paths, step size, covariance and its
+// Cholesky factor) is O(dim^2) and done on the host (cmaes.py).
+//
+// Search space: per layer (log a, log b); c follows from the layer volume.
+
+#ifndef CMAES_GLSL_C
+#define CMAES_GLSL_C
+
+#ifndef CMA_MAX_DIM
+#define CMA_MAX_DIM 40          // 2 x 20 layers
+#endif
+
+#ifndef CMA_MAX_LAMBDA
+#define CMA_MAX_LAMBDA 2048     // bounded by the shared-memory sort
+#endif
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+// Current distribution (read-only during a generation)
+layout(std430, binding = 2) readonly buffer CMADistribution {
+    double cma_mean[CMA_MAX_DIM];                 // log-axis mean
+    double cma_chol[CMA_MAX_DIM * CMA_MAX_DIM];   // lower Cholesky factor of C, row-major, stride cma_dim
+    double cma_weights[CMA_MAX_LAMBDA];           // recombination weight of rank i (i < cma_mu)
+};
+
+// Standard normal draws z (lambda x cma_dim)
+layout(std430, binding = 3) buffer CMANormals {
+    double cma_z[];
+};
+
+// Steps y = L z (lambda x cma_dim); offspring are mean + sigma * y
+layout(std430, binding = 4) buffer CMASteps {
+    double cma_y[];
+};
+
+// Output of the recombination stage
+layout(std430, binding = 5) buffer CMAUpdate {
+    double cma_best_score;                      // offset 0
+    uint cma_best_idx;                          // offset 8
+    uint _cma_pad;                              // offset 12
+    double cma_y_w[CMA_MAX_DIM];                // sum_i w_i y_i:z (i over top mu)
+    double cma_z_w[CMA_MAX_DIM];                // sum_i w_i z_i:z
+    double cma_c_mu[CMA_MAX_DIM * CMA_MAX_DIM]; // sum_i w_i y_i y_i^T (stride cma_dim)
+};
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint cma_dim;       // 2 x num_layers
+uniform uint cma_mu;        // number of parents
+uniform double cma_sigma;   // global step size
+
+#endif
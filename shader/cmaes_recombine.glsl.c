@@ -0,0 +1,110 @@
+#version 460 core
+#extension GL_ARB_gpu_shader_fp64 : require
+
+#include "shader/precision.glsl.c"
+#include "shader/model.glsl.c"
+
+// Run as a single workgroup after cmaes_sample.glsl.c.
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+// Scored offspring from the sampling stage
+layout(std430, binding = 1) buffer OutputModels {
+    Model variations[];
+};
+
+#include "shader/cmaes.glsl.c"
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint num_variations;  // lambda
+
+// ============================================================================
+// Shared memory
+// ============================================================================
+
+shared double sort_key[CMA_MAX_LAMBDA];
+shared uint sort_idx[CMA_MAX_LAMBDA];
+
+// ============================================================================
+// Main Compute Shader
+// ============================================================================
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint local_idx = gl_LocalInvocationID.x;
+    
+    // Bitonic sort needs a power of two; pad with +huge
+    uint n = 2u;
+    while (n < num_variations) {
+        n *= 2u;
+    }
+    
+    for (uint i = local_idx; i < n; i += gl_WorkGroupSize.x) {
+        sort_key[i] = (i < num_variations) ? double(variations[i].score) : 1e300LF;
+        sort_idx[i] = i;
+    }
+    barrier();
+    
+    // ========================================================================
+    // RANK OFFSPRING BY SCORE (ascending)
+    // ========================================================================
+    
+    for (uint k = 2u; k <= n; k *= 2u) {
+        for (uint j = k / 2u; j > 0u; j /= 2u) {
+            for (uint i = local_idx; i < n; i += gl_WorkGroupSize.x) {
+                uint partner = i ^ j;
+                if (partner > i) {
+                    bool ascending = (i & k) == 0u;
+                    if ((sort_key[i] > sort_key[partner]) == ascending) {
+                        double key = sort_key[i];
+                        sort_key[i] = sort_key[partner];
+                        sort_key[partner] = key;
+                        uint tmp = sort_idx[i];
+                        sort_idx[i] = sort_idx[partner];
+                        sort_idx[partner] = tmp;
+                    }
+                }
+            }
+            barrier();
+        }
+    }
+    
+    // ========================================================================
+    // WEIGHTED RECOMBINATION OF THE TOP MU
+    // ========================================================================
+    
+    if (local_idx == 0u) {
+        cma_best_score = sort_key[0];
+        cma_best_idx = sort_idx[0];
+    }
+    
+    for (uint j = local_idx; j < cma_dim; j += gl_WorkGroupSize.x) {
+        double y_w = 0.0LF;
+        double z_w = 0.0LF;
+        for (uint rank = 0u; rank < cma_mu; rank++) {
+            uint row = sort_idx[rank] * cma_dim;
+            y_w += cma_weights[rank] * cma_y[row + j];
+            z_w += cma_weights[rank] * cma_z[row + j];
+        }
+        cma_y_w[j] = y_w;
+        cma_z_w[j] = z_w;
+    }
+    
+    // Rank-mu covariance contribution
+    for (uint jk = local_idx; jk < cma_dim * cma_dim; jk += gl_WorkGroupSize.x) {
+        uint j = jk / cma_dim;
+        uint k = jk % cma_dim;
+        double c = 0.0LF;
+        for (uint rank = 0u; rank < cma_mu; rank++) {
+            uint row = sort_idx[rank] * cma_dim;
+            c += cma_weights[rank] * cma_y[row + j] * cma_y[row + k];
+        }
+        cma_c_mu[jk] = c;
+    }
+}
@@ -0,0 +1,100 @@
+#version 460 core
+#extension GL_ARB_gpu_shader_fp64 : require
+
+#include "shader/precision.glsl.c"
+#include "shader/potential.glsl.c"
+#include "shader/random.glsl.c"
+#include "shader/dmath.glsl.c"
+#include "shader/model.glsl.c"
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+// Input: the template (supplies angular momentum, volumes and densities)
+layout(std430, binding = 0) buffer InputModel 
+{
+    double template_angular_momentum;  // offset 0, 8 bytes
+    uint template_num_layers;          // offset 8, 4 bytes
+    uint _pad0;                        // offset 12, 4 bytes (explicit padding to 16)
+    Layer template_layers[20];         // offset 16, fixed array
+};
+
+// Output: lambda offspring
+layout(std430, binding = 1) buffer OutputModels {
+    Model variations[];
+};
+
+#include "shader/cmaes.glsl.c"
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint num_variations;  // lambda
+uniform uint seed;
+uniform double error_threshold;
+
+#include "shader/statistics.glsl.c"
+
+// ============================================================================
+// Main Compute Shader
+// ============================================================================
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint idx = gl_GlobalInvocationID.x;
+    
+    if (idx >= num_variations) {
+        return;
+    }
+    
+    PCGState rng;
+    initPCG(rng, seed + idx, idx);
+    
+    uint row = idx * cma_dim;
+    
+    // z ~ N(0, I) by Box-Muller (float precision is plenty for a sample)
+    for (uint j = 0; j < cma_dim; j += 2) {
+        float u1 = 1.0 - pcg_float(rng);   // (0, 1], keeps log finite
+        float u2 = pcg_float(rng);
+        float radius = sqrt(-2.0 * log(u1));
+        float angle = 6.28318530718 * u2;
+        
+        cma_z[row + j] = double(radius * cos(angle));
+        if (j + 1 < cma_dim) {
+            cma_z[row + j + 1] = double(radius * sin(angle));
+        }
+    }
+    
+    // y = L z (L lower triangular)
+    for (uint j = 0; j < cma_dim; j++) {
+        double y = 0.0LF;
+        for (uint k = 0; k <= j; k++) {
+            y += cma_chol[j * cma_dim + k] * cma_z[row + k];
+        }
+        cma_y[row + j] = y;
+    }
+    
+    // ========================================================================
+    // BUILD THE OFFSPRING: x = mean + sigma * y in (log a, log b) per layer
+    // ========================================================================
+    
+    variations[idx].num_layers = template_num_layers;
+    variations[idx].angular_momentum = template_angular_momentum;
+    
+    for (uint i = 0; i < template_num_layers; i++) {
+        double a = dexp(cma_mean[2 * i] + cma_sigma * cma_y[row + 2 * i]);
+        double b = dexp(cma_mean[2 * i + 1] + cma_sigma * cma_y[row + 2 * i + 1]);
+        double r = template_layers[i].r;
+        
+        variations[idx].layers[i].a = BR(a);
+        variations[idx].layers[i].b = BR(b);
+        variations[idx].layers[i].c = BR(r * r * r / (a * b));  // Preserve volume
+        variations[idx].layers[i].r = template_layers[i].r;
+        variations[idx].layers[i].density = template_layers[i].density;
+    }
+    
+    compute_statistics(idx);
+}
@@ -0,0 +1,48 @@
+// dmath.glsl.c
+// Double-precision versions of the transcendental functions that GLSL only
+// provides for float (exp, exp2, log, ...).
+
+#ifndef DMATH_GLSL_C
+#define DMATH_GLSL_C
+
+// e^x to ~1 ulp: reduce x = n ln2 + r with |r| <= ln2/2, sum the Taylor
+// series of e^r (13 terms is below double epsilon there), scale by 2^n.
+//
+// Only adds and multiplies (GPU double division is not correctly rounded)
+// and `precise` (no fused multiply-add), so the result is reproducible bit
+// for bit by host_variation.dexp.
+const double DEXP_INV_K[14] = double[14](
+    0.0LF, 1.0LF, 0.5LF, 0.3333333333333333LF, 0.25LF, 0.2LF,
+    0.16666666666666666LF, 0.14285714285714285LF, 0.125LF,
+    0.1111111111111111LF, 0.1LF, 0.09090909090909091LF,
+    0.08333333333333333LF, 0.07692307692307693LF);
+
+double dexp(double x)
+{
+    const double LOG2E  = 1.44269504088896338700LF;
+    const double LN2_HI = 6.93147180369123816490e-01LF;
+    const double LN2_LO = 1.90821492927058770002e-10LF;
+    
+    precise double n = roundEven(x * LOG2E);
+    precise double r = (x - n * LN2_HI) - n * LN2_LO;
+    
+    // 1 + r/1 (1 + r/2 (1 + r/3 (...)))
+    precise double p = 1.0LF;
+    for (int k = 13; k >= 1; k--) {
+        p = 1.0LF + p * r * DEXP_INV_K[k];
+    }
+    
+    return ldexp(p, int(n));
+}
+
+// Cube root of x > 0: float estimate, then two Newton steps (each roughly
+// doubles the correct digits, ~7 -> ~14 -> full).
+double dcbrt(double x)
+{
+    double y = double(pow(float(x), 1.0 / 3.0));
+    y -= (y - x / (y * y)) / 3.0LF;
+    y -= (y - x / (y * y)) / 3.0LF;
+    return y;
+}
+
+#endif
@@ -0,0 +1,42 @@
+// dual.glsl.c
+// Forward-mode automatic differentiation with dual numbers.
+//
+// A DUAL holds (value, derivative along one direction). Addition,
+// subtraction and scaling by a constant are the plain vector operations;
+// products, quotients and roots go through the helpers below.
+
+#ifndef DUAL_GLSL_C
+#define DUAL_GLSL_C
+
+#include "shader/precision.glsl.c"
+
+#define DUAL CALC_VEC2
+
+DUAL dual_const(CALC_REAL value)
+{
+    return DUAL(value, R(0.LF));
+}
+
+DUAL dual_mul(DUAL a, DUAL b)
+{
+    return DUAL(a.x * b.x, a.x * b.y + a.y * b.x);
+}
+
+DUAL dual_div(DUAL a, DUAL b)
+{
+    return DUAL(a.x / b.x, (a.y * b.x - a.x * b.y) / (b.x * b.x));
+}
+
+DUAL dual_sqrt(DUAL a)
+{
+    CALC_REAL s = sqrt(a.x);
+    return DUAL(s, a.y / (R(2.LF) * s));
+}
+
+DUAL dual_inversesqrt(DUAL a)
+{
+    CALC_REAL s = inversesqrt(a.x);
+    return DUAL(s, R(-0.5LF) * a.y * s * s * s);
+}
+
+#endif
@@ -1,44 +1,40 @@
 #version 460 core
 #extension GL_ARB_gpu_shader_fp64 : require
+#ifdef COMPACT_HITS
+#extension GL_KHR_shader_subgroup_ballot : require
+#endif
 
 #include "shader/precision.glsl.c"
 #include "shader/potential.glsl.c"
 #include "shader/random.glsl.c"
+#include "shader/variation.glsl.c"
+#include "shader/model.glsl.c"
 
 // ============================================================================
-// Data Structures
+// Buffers
 // ============================================================================
 
-struct Layer {
-    BUFF_REAL a;
-    BUFF_REAL b;
-    BUFF_REAL c;
-    BUFF_REAL r;
-    BUFF_REAL density;
-};
+#ifdef MULTI_TEMPLATE
+#ifdef ADAPTIVE_TEMPERATURE
+#error "MULTI_TEMPLATE and ADAPTIVE_TEMPERATURE are mutually exclusive"
+#endif
 
-struct Model {
-    BUFF_REAL angular_momentum;  // offset 0, 8 bytes
-    uint num_layers;             // offset 8, 4 bytes
-    // implicit 4 bytes padding to align array to 16-byte boundary
-    Layer layers[20];            // offset 16, 800 bytes (20 × 40)
-    
-    BUFF_REAL rel_equipotential_err;  // offset 816, 8 bytes
-    BUFF_REAL total_energy;           // offset 824, 8 bytes
-    BUFF_REAL angular_velocity;       // offset 832, 8 bytes
-    BUFF_REAL moment_of_inertia;      // offset 840, 8 bytes
-    BUFF_REAL potential_energy;       // offset 848, 8 bytes
-    BUFF_REAL kinetic_energy;         // offset 856, 8 bytes
-    BUFF_REAL virial_ratio;           // offset 864, 8 bytes
-    BUFF_REAL padding_sentinel;       // offset 872, 8 bytes
-    BUFF_REAL score;                  // offset 880, 8 bytes
-    // Total size: 888 bytes
+// Input: a batch of template models. Template t is explored by workgroups
+// [t * blocks_per_template, (t + 1) * blocks_per_template), so workgroup
+// bests come out grouped by template.
+layout(std430, binding = 0) buffer InputModels
+{
+    Model templates[];
 };
 
-// ============================================================================
-// Buffers
-// ============================================================================
+// Set once at the top of main(); the template_* names below then read the
+// workgroup's own template, so the rest of the shader is unchanged.
+uint template_id;
 
+#define template_angular_momentum templates[template_id].angular_momentum
+#define template_num_layers templates[template_id].num_layers
+#define template_layers templates[template_id].layers
+#else
 // Input: The template model (flexible array, so slightly different layout)
 layout(std430, binding = 0) buffer InputModel 
 {
@@ -47,30 +43,151 @@ layout(std430, binding = 0) buffer InputModel
     uint _pad0;                        // offset 12, 4 bytes (explicit padding to 16)
     Layer template_layers[20];         // offset 16, fixed array
 };
+#endif
+
+#ifdef FIXED_NUM_LAYERS
+// Layer count compiled in (every template must have this many layers), so
+// the per-layer loops unroll
+#undef template_num_layers
+#define template_num_layers (FIXED_NUM_LAYERS)
+#endif
 
 // Output: N variations of the model
+#ifdef PARETO_FRONT
+// (coherent: the last workgroup copies the front's models out of here)
+layout(std430, binding = 1) coherent buffer OutputModels {
+#else
 layout(std430, binding = 1) buffer OutputModels {
+#endif
     Model variations[];
 };
 
 // Workgroup best models
-layout(std430, binding = 2) buffer WorkgroupBests {
+// (coherent: the last workgroup of a dispatch may read the others' results)
+layout(std430, binding = 2) coherent buffer WorkgroupBests {
     Model workgroup_best_models[];
 };
 
 // Workgroup best scores
-layout(std430, binding = 3) buffer WorkgroupBestScores {
+layout(std430, binding = 3) coherent buffer WorkgroupBestScores {
     double workgroup_best_scores[];
 };
 
+#ifdef COMPACT_HITS
+// Number of variations that came in under error_threshold. May exceed
+// compact_capacity; only the first compact_capacity hits are stored.
+layout(std430, binding = 4) buffer CompactCount {
+    uint compact_count;
+};
+
+// Hits, packed densely in arbitrary order
+layout(std430, binding = 5) buffer CompactModels {
+    Model compact_models[];
+};
+#endif
+
+#ifdef SCORE_HISTOGRAM
+// Log-scale histograms of score and rel_equipotential_err over all
+// variations. Bin layout is injected by ScoreHistogram.defines().
+// Must be zeroed by the host before the dispatch.
+layout(std430, binding = 6) buffer ScoreHistogram {
+    uint score_hist[HIST_BINS];
+    uint err_hist[HIST_BINS];
+};
+#endif
+
+#ifdef ADAPTIVE_TEMPERATURE
+// Annealing state carried across the dispatches of a multi-generation run.
+// Each dispatch counts, per layer, how many variations beat the template's
+// equipotential error on that layer's surface. The last workgroup to finish
+// promotes the generation's best to the template and nudges each layer's
+// temperature toward target_acceptance, so no host round trip is needed
+// between generations.
+layout(std430, binding = 7) coherent buffer AnnealState {
+    double template_score;             // offset 0
+    uint initialized;                  // offset 8 (0: next dispatch evaluates the bare template)
+    uint workgroups_done;              // offset 12
+    uint generation;                   // offset 16
+    uint _pad1;                        // offset 20
+    double layer_temperature[20];      // offset 24
+    double template_layer_err[20];     // offset 184
+    uint improved[20];                 // offset 344
+    uint evaluated;                    // offset 424
+    uint _pad2;                        // offset 428
+    // Total size: 432 bytes
+};
+
+// Per-layer errors of each workgroup's best model (20 per workgroup)
+layout(std430, binding = 8) coherent buffer WorkgroupBestLayerErr {
+    double workgroup_best_layer_err[];
+};
+#endif
+
+#ifdef PARETO_FRONT
+// Bounded archive of the (rel_equipotential_err, kinetic_energy) front.
+// Errors are binned on a log10 scale (PARETO_BINS bins over
+// [10^PARETO_LOG10_MIN, 10^PARETO_LOG10_MAX], injected by the host); each
+// bin keeps its lowest-energy variation, and a bin is on the front when
+// every lower-error bin has higher energy. Energies are compared through
+// their float bit patterns, which order like the values for positive
+// floats, so plain uint atomicMin merges them.
+// Must be initialized by the host: energy bits to 0xFFFFFFFF, rest zero.
+layout(std430, binding = 9) coherent buffer ParetoArchive {
+    uint pareto_energy_bits[PARETO_BINS];
+    uint pareto_idx[PARETO_BINS];
+    uint pareto_on_front[PARETO_BINS];
+    uint pareto_candidate_count;
+    uint pareto_workgroups_done;
+};
+
+// Every workgroup's local front as (bin, energy bits, variation index, -)
+// (room for PARETO_BINS entries per workgroup)
+layout(std430, binding = 10) coherent buffer ParetoCandidates {
+    uvec4 pareto_candidates[];
+};
+
+// Models of the front bins (other slots are left untouched)
+layout(std430, binding = 11) buffer ParetoModels {
+    Model pareto_models[PARETO_BINS];
+};
+#endif
+
+#ifdef SCORE_INDEX
+// (score, variation index) of every variation: 16 bytes instead of a whole
+// Model record. A variation is a deterministic function of (template, seed,
+// index, temperature), so the host regenerates the winners from their
+// indices (host_variation.py) rather than reading them back.
+struct ScoreIndex {
+    double score;
+    uint idx;
+    uint _pad;
+};
+
+layout(std430, binding = 12) buffer ScoreIndices {
+    ScoreIndex score_index[];
+};
+#endif
+
 // ============================================================================
 // Uniforms
 // ============================================================================
 
 uniform double annealing_temperature;
-uniform uint num_variations;  // N
+uniform uint num_variations;  // N (per template with MULTI_TEMPLATE)
 uniform uint seed;
 uniform double error_threshold;
+#ifdef COMPACT_HITS
+uniform uint compact_capacity;
+#endif
+#ifdef MULTI_TEMPLATE
+uniform uint blocks_per_template;  // workgroups per template
+#endif
+#ifdef ADAPTIVE_TEMPERATURE
+uniform double target_acceptance;  // desired fraction of improving samples per layer
+uniform double adapt_rate;         // gain of the multiplicative temperature update
+uniform double min_temperature;
+uniform double max_temperature;
+#endif
 
 // ============================================================================
 // Shared memory for workgroup reduction
@@ -79,144 +196,185 @@ uniform double error_threshold;
 shared uint local_best_idx;
 shared BUFF_REAL local_best_score;
 
+#ifdef SCORE_HISTOGRAM
+shared uint local_score_hist[HIST_BINS];
+shared uint local_err_hist[HIST_BINS];
+#endif
+
+#ifdef PARETO_FRONT
+shared uint local_pareto_energy[PARETO_BINS];
+shared uint local_pareto_idx[PARETO_BINS];
+shared bool local_pareto_last;
+#endif
+
+#ifdef ADAPTIVE_TEMPERATURE
+shared uint local_improved[20];
+shared uint local_evaluated;
+shared bool local_is_last;
+shared double local_reduce_score[256];
+shared uint local_reduce_idx[256];
+#endif
+
+#include "shader/statistics.glsl.c"
+
+#ifdef SCORE_HISTOGRAM
 // ============================================================================
-// Statistics computation
+// Histogram
 // ============================================================================
 
-void compute_statistics(uint idx)
+// Log10-spaced bin for a value; out-of-range values land in the edge bins.
+// Binning only needs float precision (and float covers the 1e30 penalty).
+uint histogram_bin(BUFF_REAL value)
 {
-    bool valid = true;
-    
-    // Initialize error accumulator to zero
-    variations[idx].rel_equipotential_err = BR(0.0LF);
-    
-    // compute Moment of Inertia
-    CALC_REAL moi = R(0.LF);    
-    for (uint layer_idx = 0; layer_idx < variations[idx].num_layers; layer_idx++)
-    {
-        moi += variations[idx].layers[layer_idx].density 
-                * variations[idx].layers[layer_idx].a 
-                * variations[idx].layers[layer_idx].b 
-                * variations[idx].layers[layer_idx].c 
-                * (variations[idx].layers[layer_idx].a * variations[idx].layers[layer_idx].a 
-                    + variations[idx].layers[layer_idx].b * variations[idx].layers[layer_idx].b);
+    float log10_value = log2(float(max(value, BUFF_REAL(0.0)))) * 0.30102999566;
+    float pos = (log10_value - float(HIST_LOG10_MIN)) 
+              * float(HIST_BINS) / float(HIST_LOG10_MAX - HIST_LOG10_MIN);
+    return uint(clamp(pos, 0.0, float(HIST_BINS - 1)));
+}
+#endif
+
+#ifdef PARETO_FRONT
+// ============================================================================
+// Pareto archive
+// ============================================================================
+
+// Log10-spaced error bin, or PARETO_BINS for invalid models (which never
+// enter the archive). Errors below the range share the first bin.
+uint pareto_bin(BUFF_REAL err)
+{
+    if (!(err < BR(1e30LF))) {
+        return uint(PARETO_BINS);
     }
-    moi *= R(4.LF/15.LF) * PI;
-    
-    // Store moment of inertia
-    variations[idx].moment_of_inertia = BR(moi);
-    
-    // compute Angular Velocity
-    CALC_REAL ang_vel = variations[idx].angular_momentum / moi;
-    
-    // Store angular velocity
-    variations[idx].angular_velocity = BR(ang_vel);
-    
-    // Iterate through the layers to get the points we want to calculate the potential at
-    for (uint surf_layer_idx = 0; surf_layer_idx < variations[idx].num_layers; surf_layer_idx++)
-    {
-        // accumulate the effective potential at (a,0,0), (0,b,0), and (0,0,c)
-        // start with the centrifugal contribution before iterating through layers
-        // (Note: Chandrasekhar convention is that these are positive. I'd argue with
-        // him, but sadly, he has passed on.)
-        CALC_REAL pot_a = R(0.5LF) 
-                        * ang_vel * ang_vel 
-                        * variations[idx].layers[surf_layer_idx].a * variations[idx].layers[surf_layer_idx].a;
-        CALC_REAL pot_b = R(0.5LF) 
-                        * ang_vel * ang_vel 
-                        * variations[idx].layers[surf_layer_idx].b * variations[idx].layers[surf_layer_idx].b;
-        CALC_REAL pot_c = 0.LF;
-         
-        // Iterate through the layers to get the ellipsoid creating a potential at the points
-        for (uint mass_layer_idx = 0; mass_layer_idx < variations[idx].num_layers; mass_layer_idx++)
-        {
-            if (surf_layer_idx <= mass_layer_idx)
-            {
-                // The surface points will be inside or on the ellipsoid
-                
-                pot_a += variations[idx].layers[mass_layer_idx].density * 
-                                potential_interior_x(
-                                        variations[idx].layers[mass_layer_idx].a, 
-                                        variations[idx].layers[mass_layer_idx].b, 
-                                        variations[idx].layers[mass_layer_idx].c, 
-                                        variations[idx].layers[surf_layer_idx].a);
-                pot_b += variations[idx].layers[mass_layer_idx].density *
-                                potential_interior_y(
-                                        variations[idx].layers[mass_layer_idx].a, 
-                                        variations[idx].layers[mass_layer_idx].b, 
-                                        variations[idx].layers[mass_layer_idx].c, 
-                                        variations[idx].layers[surf_layer_idx].b);
-                pot_c += variations[idx].layers[mass_layer_idx].density * 
-                                potential_interior_z(
-                                        variations[idx].layers[mass_layer_idx].a, 
-                                        variations[idx].layers[mass_layer_idx].b, 
-                                        variations[idx].layers[mass_layer_idx].c, 
-                                        variations[idx].layers[surf_layer_idx].c);
-                
+    float log10_err = log2(float(max(err, BUFF_REAL(1e-300LF)))) * 0.30102999566;
+    float pos = (log10_err - float(PARETO_LOG10_MIN))
+              * float(PARETO_BINS) / float(PARETO_LOG10_MAX - PARETO_LOG10_MIN);
+    return uint(clamp(pos, 0.0, float(PARETO_BINS - 1)));
+}
+
+// Run by the last workgroup: resolve each bin's winner among the
+// candidates, mark the front, and copy its models out.
+void finish_pareto(uint local_idx)
+{
+    uint count = pareto_candidate_count;
+    for (uint k = local_idx; k < count; k += gl_WorkGroupSize.x) {
+        uvec4 cand = pareto_candidates[k];
+        if (cand.y == pareto_energy_bits[cand.x]) {
+            pareto_idx[cand.x] = cand.z;  // ties: any of them
+        }
+    }
+    memoryBarrierBuffer();
+    barrier();
+    
+    if (local_idx == 0u) {
+        uint running = 0xFFFFFFFFu;
+        for (uint bin = 0u; bin < PARETO_BINS; bin++) {
+            bool on_front = pareto_energy_bits[bin] < running;
+            pareto_on_front[bin] = on_front ? 1u : 0u;
+            if (on_front) {
+                running = pareto_energy_bits[bin];
             }
-            else
-            {
-                // The surface points will be outside the ellipsoid
-                
-                // check for bad overlap
-                valid = valid 
-                        && (variations[idx].layers[surf_layer_idx].a > variations[idx].layers[mass_layer_idx].a) 
-                        && (variations[idx].layers[surf_layer_idx].b > variations[idx].layers[mass_layer_idx].b) 
-                        && (variations[idx].layers[surf_layer_idx].c > variations[idx].layers[mass_layer_idx].c);
-                
-                pot_a += variations[idx].layers[mass_layer_idx].density * 
-                                potential_exterior_x(
-                                        variations[idx].layers[mass_layer_idx].a, 
-                                        variations[idx].layers[mass_layer_idx].b, 
-                                        variations[idx].layers[mass_layer_idx].c, 
-                                        variations[idx].layers[surf_layer_idx].a);
-                pot_b += variations[idx].layers[mass_layer_idx].density *
-                                potential_exterior_y(
-                                        variations[idx].layers[mass_layer_idx].a, 
-                                        variations[idx].layers[mass_layer_idx].b, 
-                                        variations[idx].layers[mass_layer_idx].c, 
-                                        variations[idx].layers[surf_layer_idx].b);
-                pot_c += variations[idx].layers[mass_layer_idx].density * 
-                                potential_exterior_z(
-                                        variations[idx].layers[mass_layer_idx].a, 
-                                        variations[idx].layers[mass_layer_idx].b, 
-                                        variations[idx].layers[mass_layer_idx].c, 
-                                        variations[idx].layers[surf_layer_idx].c);
+        }
+    }
+    memoryBarrierBuffer();
+    barrier();
+    
+    for (uint bin = local_idx; bin < PARETO_BINS; bin += gl_WorkGroupSize.x) {
+        if (pareto_on_front[bin] != 0u) {
+            pareto_models[bin] = variations[pareto_idx[bin]];
+        }
+    }
+}
+#endif
+
+#ifdef ADAPTIVE_TEMPERATURE
+// ============================================================================
+// End-of-generation update (run by the last workgroup of the dispatch)
+// ============================================================================
+
+void finish_generation(uint local_idx)
+{
+    // Find the generation's best workgroup
+    uint num_workgroups = gl_NumWorkGroups.x;
+    double best_score = 1e30LF;
+    uint best_wg = 0u;
+    for (uint wg = local_idx; wg < num_workgroups; wg += gl_WorkGroupSize.x) {
+        if (workgroup_best_scores[wg] < best_score) {
+            best_score = workgroup_best_scores[wg];
+            best_wg = wg;
+        }
+    }
+    local_reduce_score[local_idx] = best_score;
+    local_reduce_idx[local_idx] = best_wg;
+    barrier();
+    
+    for (uint stride = gl_WorkGroupSize.x / 2u; stride > 0u; stride /= 2u) {
+        if (local_idx < stride 
+                && local_reduce_score[local_idx + stride] < local_reduce_score[local_idx]) {
+            local_reduce_score[local_idx] = local_reduce_score[local_idx + stride];
+            local_reduce_idx[local_idx] = local_reduce_idx[local_idx + stride];
+        }
+        barrier();
+    }
+    
+    if (local_idx == 0u) {
+        best_score = local_reduce_score[0];
+        best_wg = local_reduce_idx[0];
+        
+        // Adapt temperatures from this generation's acceptance counts
+        if (initialized != 0u && evaluated > 0u) {
+            for (uint i = 0u; i < template_num_layers; i++) {
+                double rate = double(improved[i]) / double(evaluated);
+                double factor = exp(float(adapt_rate * (rate - target_acceptance) / target_acceptance));
+                layer_temperature[i] = clamp(layer_temperature[i] * factor, 
+                                             min_temperature, max_temperature);
             }
         }
         
-        CALC_REAL max_pot = max(pot_a, max(pot_b, pot_c));
-        CALC_REAL min_pot = min(pot_a, min(pot_b, pot_c));
-      
-        variations[idx].rel_equipotential_err += (max_pot - min_pot) / min_pot;  
+        // Promote the generation's best to be the next template
+        if (initialized == 0u || best_score < template_score) {
+            template_score = best_score;
+            for (uint i = 0u; i < template_num_layers; i++) {
+                template_layers[i].a = workgroup_best_models[best_wg].layers[i].a;
+                template_layers[i].b = workgroup_best_models[best_wg].layers[i].b;
+                template_layers[i].c = workgroup_best_models[best_wg].layers[i].c;
+                template_layer_err[i] = workgroup_best_layer_err[best_wg * 20u + i];
+            }
+        }
+        
+        for (uint i = 0u; i < 20u; i++) {
+            improved[i] = 0u;
+        }
+        evaluated = 0u;
+        workgroups_done = 0u;
+        initialized = 1u;
+        generation++;
     }
+}
+#endif
+
+#ifdef COMPACT_HITS
+// ============================================================================
+// Compaction
+// ============================================================================
+
+// Reserve an output slot for every invocation with hit == true. One atomic
+// per subgroup instead of one per hit: the elected invocation bumps the
+// counter by the ballot count and each hit takes its rank within the ballot.
+// Must be reached by all active invocations of the subgroup.
+uint subgroup_append(bool hit)
+{
+    uvec4 ballot = subgroupBallot(hit);
+    uint hits = subgroupBallotBitCount(ballot);
     
-    variations[idx].rel_equipotential_err = valid ? variations[idx].rel_equipotential_err / variations[idx].num_layers : BR(1e30LF);
-    
-    // Stub out energy fields for now
-    variations[idx].potential_energy = BR(0.0LF);
-    variations[idx].kinetic_energy = BR(0.5LF) * BR(moi) * BR(ang_vel) * BR(ang_vel);
-    variations[idx].total_energy = variations[idx].potential_energy + variations[idx].kinetic_energy;
-    variations[idx].virial_ratio = BR(0.0LF);  // Will be 2*KE / |PE| once PE is implemented
-    
-    // Set sentinel to pi
-    variations[idx].padding_sentinel = BR(3.14159265358979323846LF);
-    
-    // Compute score based on error_threshold
-    if (error_threshold == 0.0) {
-        // Score by error alone
-        variations[idx].score = variations[idx].rel_equipotential_err;
-    } else {
-        // Score by KE if error is below threshold, otherwise penalize heavily
-        if (variations[idx].rel_equipotential_err < BR(error_threshold)) {
-            variations[idx].score = variations[idx].kinetic_energy;
-        } else {
-            variations[idx].score = BR(1e30LF);
-        }
+    uint base = 0u;
+    if (subgroupElect() && hits > 0u) {
+        base = atomicAdd(compact_count, hits);
     }
+    base = subgroupBroadcastFirst(base);
     
-    return;
+    return base + subgroupBallotExclusiveBitCount(ballot);
 }
+#endif
 
 // ============================================================================
 // Main Compute Shader
@@ -229,15 +387,50 @@ void main() {
     uint local_idx = gl_LocalInvocationID.x;
     uint workgroup_id = gl_WorkGroupID.x;
     
+#ifdef MULTI_TEMPLATE
+    template_id = workgroup_id / blocks_per_template;
+    uint variant_idx = idx - template_id * blocks_per_template * gl_WorkGroupSize.x;
+    bool in_range = variant_idx < num_variations;
+#else
+    bool in_range = idx < num_variations;
+#endif
+    
     // Initialize shared memory once per workgroup
+    // (local_best_idx starts at the workgroup's first variation, which is
+    // always in range, so a workgroup whose scores are all 1e30 still
+    // reports one of its own variations)
     if (local_idx == 0) {
-        local_best_idx = 0;
+        local_best_idx = workgroup_id * gl_WorkGroupSize.x;
         local_best_score = BR(1e30LF);
     }
+#ifdef SCORE_HISTOGRAM
+    for (uint bin = local_idx; bin < HIST_BINS; bin += gl_WorkGroupSize.x) {
+        local_score_hist[bin] = 0u;
+        local_err_hist[bin] = 0u;
+    }
+#endif
+#ifdef PARETO_FRONT
+    for (uint bin = local_idx; bin < PARETO_BINS; bin += gl_WorkGroupSize.x) {
+        local_pareto_energy[bin] = 0xFFFFFFFFu;
+    }
+#endif
+#ifdef ADAPTIVE_TEMPERATURE
+    if (local_idx < 20u) {
+        local_improved[local_idx] = 0u;
+    }
+    if (local_idx == 0u) {
+        local_evaluated = 0u;
+    }
+#endif
     barrier();
     
+#ifdef PARETO_FRONT
+    uint my_pareto_bin = uint(PARETO_BINS);
+    uint my_pareto_energy = 0xFFFFFFFFu;
+#endif
+    
     // Guard against excess threads
-    if (idx < num_variations) {
+    if (in_range) {
         
         // Initialize RNG for this thread
         PCGState rng;
@@ -258,29 +451,35 @@ void main() {
             variations[idx].layers[i].r = template_layers[i].r;
             variations[idx].layers[i].density = template_layers[i].density;
             
-            if (annealing_temperature == 0.0) 
-            {                
-                variations[idx].layers[i].a = template_layers[i].a;
-                variations[idx].layers[i].b = template_layers[i].b;
-                variations[idx].layers[i].c = template_layers[i].c;
-            } 
-            else 
-            {
-                BUFF_REAL mul1, mul2, mul3;
+#ifdef ADAPTIVE_TEMPERATURE
+            // The first dispatch of a run only scores the template itself
+            double layer_temp = (initialized == 0u) ? 0.0LF : layer_temperature[i];
+#else
+            double layer_temp = annealing_temperature;
+#endif
             
-                float rand1 = 1.5 * pcg_float(rng);
-                float rand2 = 1.5 * pcg_float(rng);
-                float rand3 = 1.5 * pcg_float(rng);
-                float avg = (rand1+rand2+rand3) / 3.0;
-                
-                // exp2 only accepts float in GLSL
-                mul1 = BR(exp2( (rand1 - avg) * float(annealing_temperature) ));
-                mul2 = BR(exp2( (rand2 - avg) * float(annealing_temperature) ));
-                mul3 = BR(1.LF) / (mul1 * mul2);  // Preserve volume
+            BUFF_REAL a = template_layers[i].a;
+            BUFF_REAL b = template_layers[i].b;
+            BUFF_REAL c = template_layers[i].c;
             
-                variations[idx].layers[i].a = template_layers[i].a * mul1;
-                variations[idx].layers[i].b = template_layers[i].b * mul2;
-                variations[idx].layers[i].c = template_layers[i].c * mul3;
+            if (layer_temp != 0.0) 
+            {
+                perturb_axes(rng, layer_temp, a, b, c);
+            }
+            
+            variations[idx].layers[i].a = a;
+            variations[idx].layers[i].b = b;
+            variations[idx].layers[i].c = c;
+        }
+        
+        // Mirror image with a >= b on the outer layer (all layers swap
+        // together, as in cluster.glsl.c)
+        uint outer = template_num_layers - 1u;
+        if (variations[idx].layers[outer].b > variations[idx].layers[outer].a) {
+            for (uint i = 0; i < template_num_layers; i++) {
+                BUFF_REAL a = variations[idx].layers[i].a;
+                variations[idx].layers[i].a = variations[idx].layers[i].b;
+                variations[idx].layers[i].b = a;
             }
         }
         
@@ -289,7 +488,45 @@ void main() {
         // ====================================================================
         compute_statistics(idx);
         
+#ifdef SCORE_INDEX
+        score_index[idx] = ScoreIndex(double(variations[idx].score), idx, 0u);
+#endif
+        
+#ifdef SCORE_HISTOGRAM
+        atomicAdd(local_score_hist[histogram_bin(variations[idx].score)], 1u);
+        atomicAdd(local_err_hist[histogram_bin(variations[idx].rel_equipotential_err)], 1u);
+#endif
+        
+#ifdef PARETO_FRONT
+        my_pareto_bin = pareto_bin(variations[idx].rel_equipotential_err);
+        my_pareto_energy = floatBitsToUint(float(variations[idx].kinetic_energy));
+#endif
+        
+#ifdef ADAPTIVE_TEMPERATURE
+        // Acceptance statistics: which layers got closer to equipotential
+        if (initialized != 0u && variations[idx].rel_equipotential_err < BR(1e30LF)) {
+            for (uint i = 0; i < template_num_layers; i++) {
+                if (stat_layer_err[i] < template_layer_err[i]) {
+                    atomicAdd(local_improved[i], 1u);
+                }
+            }
+        }
+        atomicAdd(local_evaluated, 1u);
+#endif
+    }
+    
+#ifdef COMPACT_HITS
+    // ========================================================================
+    // APPEND HITS (only variations under error_threshold leave the GPU)
+    // ========================================================================
+    
+    bool hit = in_range
+            && (variations[idx].rel_equipotential_err < BR(error_threshold));
+    uint slot = subgroup_append(hit);
+    if (hit && slot < compact_capacity) {
+        compact_models[slot] = variations[idx];
     }
+#endif
     
     // ========================================================================
     // WORKGROUP REDUCTION (find best within workgroup)
@@ -297,19 +534,18 @@ void main() {
     
     barrier();
     
-    // Each thread competes sequentially (slow but correct)
-    if (idx < num_variations) {
-        BUFF_REAL my_score = variations[idx].score;
-        
-        for (uint i = 0; i < 256; i++) {
-            if (local_idx == i) {
-                if (my_score < local_best_score) {
-                    local_best_score = my_score;
-                    local_best_idx = idx;
-                }
+    // Each thread competes sequentially (slow but correct). Out-of-range
+    // threads compete with 1e30 so every invocation reaches each barrier.
+    BUFF_REAL my_score = in_range ? variations[idx].score : BR(1e30LF);
+    
+    for (uint i = 0; i < 256; i++) {
+        if (local_idx == i) {
+            if (my_score < local_best_score) {
+                local_best_score = my_score;
+                local_best_idx = idx;
             }
-            barrier();
         }
+        barrier();
     }
     
     // First thread in workgroup writes the workgroup's best
@@ -317,4 +553,98 @@ void main() {
         workgroup_best_models[workgroup_id] = variations[local_best_idx];
         workgroup_best_scores[workgroup_id] = local_best_score;
     }
+    
+#ifdef ADAPTIVE_TEMPERATURE
+    // ========================================================================
+    // PUBLISH ACCEPTANCE COUNTS; LAST WORKGROUP CLOSES THE GENERATION
+    // ========================================================================
+    
+    barrier();
+    
+    // The winner still has its per-layer errors in registers
+    if (in_range && idx == local_best_idx) {
+        for (uint i = 0; i < template_num_layers; i++) {
+            workgroup_best_layer_err[workgroup_id * 20u + i] = stat_layer_err[i];
+        }
+    }
+    if (local_idx < template_num_layers && local_improved[local_idx] > 0u) {
+        atomicAdd(improved[local_idx], local_improved[local_idx]);
+    }
+    
+    memoryBarrier();
+    barrier();
+    
+    if (local_idx == 0u) {
+        atomicAdd(evaluated, local_evaluated);
+        memoryBarrier();
+        local_is_last = atomicAdd(workgroups_done, 1u) == gl_NumWorkGroups.x - 1u;
+    }
+    barrier();
+    
+    if (local_is_last) {
+        memoryBarrier();
+        finish_generation(local_idx);
+    }
+#endif
+    
+#ifdef PARETO_FRONT
+    // ========================================================================
+    // LOCAL FRONT INTO THE GLOBAL ARCHIVE; LAST WORKGROUP FINALIZES IT
+    // ========================================================================
+    
+    barrier();
+    
+    if (my_pareto_bin < PARETO_BINS) {
+        atomicMin(local_pareto_energy[my_pareto_bin], my_pareto_energy);
+    }
+    barrier();
+    if (my_pareto_bin < PARETO_BINS && my_pareto_energy == local_pareto_energy[my_pareto_bin]) {
+        local_pareto_idx[my_pareto_bin] = idx;
+    }
+    barrier();
+    
+    if (local_idx == 0u) {
+        // Bins not dominated within this workgroup, by increasing error
+        uint running = 0xFFFFFFFFu;
+        for (uint bin = 0u; bin < PARETO_BINS; bin++) {
+            uint energy = local_pareto_energy[bin];
+            if (energy < running) {
+                running = energy;
+                uint slot = atomicAdd(pareto_candidate_count, 1u);
+                pareto_candidates[slot] = uvec4(bin, energy, local_pareto_idx[bin], 0u);
+                atomicMin(pareto_energy_bits[bin], energy);
+            }
+        }
+    }
+    
+    memoryBarrier();
+    barrier();
+    
+    if (local_idx == 0u) {
+        local_pareto_last = atomicAdd(pareto_workgroups_done, 1u) == gl_NumWorkGroups.x - 1u;
+    }
+    barrier();
+    
+    if (local_pareto_last) {
+        memoryBarrier();
+        finish_pareto(local_idx);
+    }
+#endif
+    
+#ifdef SCORE_HISTOGRAM
+    // ========================================================================
+    // MERGE WORKGROUP HISTOGRAM INTO GLOBAL HISTOGRAM
+    // ========================================================================
+    
+    barrier();
+    
+    for (uint bin = local_idx; bin < HIST_BINS; bin += gl_WorkGroupSize.x) {
+        if (local_score_hist[bin] > 0u) {
+            atomicAdd(score_hist[bin], local_score_hist[bin]);
+        }
+        if (local_err_hist[bin] > 0u) {
+            atomicAdd(err_hist[bin], local_err_hist[bin]);
+        }
+    }
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,216 @@
+#version 460 core
+#extension GL_ARB_gpu_shader_fp64 : require
+
+#include "shader/precision.glsl.c"
+#include "shader/potential.glsl.c"
+#include "shader/dmath.glsl.c"
+#include "shader/model.glsl.c"
+
+// Multi-resolution map of equipotential error over (b/a, c/a).
+//
+// Every layer of the template takes the same axis ratios at its own volume.
+// The map is a quadtree of cells stored in one flat list. A dispatch
+// processes one level: each cell is scored at its four corners (one
+// invocation per corner, 64 cells per workgroup), and a cell whose best
+// corner is under refine_error, or whose corner errors span more than
+// refine_gradient decades, appends its four children to the list. The
+// last workgroup to finish records where the next level starts, so the
+// host issues one dispatch per level with no readback in between.
+
+#ifndef LANDSCAPE_MAX_LEVELS
+#define LANDSCAPE_MAX_LEVELS 16
+#endif
+
+#define NO_CHILDREN 0xFFFFFFFFu
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+
+struct LandscapeCell {
+    uint level;             // offset 0
+    uint i;                 // offset 4  (b/a index at this level)
+    uint j;                 // offset 8  (c/a index at this level)
+    uint first_child;       // offset 12 (NO_CHILDREN for leaves)
+    double corner_err[4];   // offset 16 (corners (i,j), (i+1,j), (i,j+1), (i+1,j+1))
+    double corner_score[4]; // offset 48
+    // Total size: 80 bytes
+};
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+// Input: The template model (same layout as the explorer's)
+layout(std430, binding = 0) buffer InputModel
+{
+    double template_angular_momentum;  // offset 0, 8 bytes
+    uint template_num_layers;          // offset 8, 4 bytes
+    uint _pad0;                        // offset 12, 4 bytes (explicit padding to 16)
+    Layer template_layers[20];         // offset 16, fixed array
+};
+
+// Scratch: one model per invocation, for compute_statistics
+layout(std430, binding = 1) buffer ScratchModels {
+    Model variations[];
+};
+
+// The quadtree, all levels in order
+layout(std430, binding = 2) coherent buffer LandscapeCells {
+    LandscapeCell cells[];
+};
+
+layout(std430, binding = 3) coherent buffer LandscapeState {
+    uint cell_count;                            // offset 0
+    uint workgroups_done;                       // offset 4
+    uint overflow;                              // offset 8 (children dropped at capacity)
+    uint first_overflow;                        // offset 12 (lowest failed slot; 0xFFFFFFFF if none)
+    uint level_begin[LANDSCAPE_MAX_LEVELS + 2]; // offset 16
+};
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint level;             // level processed by this dispatch
+uniform uint max_level;         // cells at this level are never refined
+uniform uint base_cells;        // cells per side at level 0
+uniform dvec2 ratio_min;        // (b/a, c/a) at the lower corner of the map
+uniform dvec2 ratio_max;        // (b/a, c/a) at the upper corner
+uniform double refine_error;    // refine cells with a corner below this error
+uniform double refine_gradient; // ...or corners spanning more decades than this
+uniform uint capacity;          // size of the cell list
+uniform double error_threshold;
+
+#include "shader/statistics.glsl.c"
+
+// ============================================================================
+// Shared memory
+// ============================================================================
+
+shared double local_err[256];
+shared double local_score[256];
+shared bool local_is_last;
+
+// ============================================================================
+// Main Compute Shader
+// ============================================================================
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint idx = gl_GlobalInvocationID.x;
+    uint local_idx = gl_LocalInvocationID.x;
+
+    uint begin = level_begin[level];
+    uint end = level_begin[level + 1u];
+
+    uint cells_per_group = gl_WorkGroupSize.x / 4u;
+    uint corner = local_idx & 3u;
+    uint local_cell = local_idx >> 2u;
+
+    double cells_per_side = double(base_cells << level);
+    dvec2 spacing = (ratio_max - ratio_min) / cells_per_side;
+
+    // Grid-stride over the level's cells; the loop bound is uniform across
+    // the workgroup, so the barriers inside are safe
+    for (uint group_base = begin + gl_WorkGroupID.x * cells_per_group;
+         group_base < end;
+         group_base += gl_NumWorkGroups.x * cells_per_group)
+    {
+        uint cell_idx = group_base + local_cell;
+        bool active = cell_idx < end;
+
+        if (active) {
+            // Corner (i + di, j + dj) in (b/a, c/a)
+            LandscapeCell cell = cells[cell_idx];
+            dvec2 ratio = ratio_min + spacing * dvec2(double(cell.i + (corner & 1u)),
+                                                      double(cell.j + (corner >> 1u)));
+
+            // a^3 (b/a)(c/a) = r^3 keeps each layer's volume
+            double scale = 1.0LF / dcbrt(ratio.x * ratio.y);
+
+            variations[idx].num_layers = template_num_layers;
+            variations[idx].angular_momentum = template_angular_momentum;
+            for (uint k = 0u; k < template_num_layers; k++) {
+                BUFF_REAL r = template_layers[k].r;
+                variations[idx].layers[k].r = r;
+                variations[idx].layers[k].density = template_layers[k].density;
+                variations[idx].layers[k].a = BR(r * scale);
+                variations[idx].layers[k].b = BR(r * scale * ratio.x);
+                variations[idx].layers[k].c = BR(r * scale * ratio.y);
+            }
+
+            compute_statistics(idx);
+
+            local_err[local_idx] = variations[idx].rel_equipotential_err;
+            local_score[local_idx] = variations[idx].score;
+        }
+        barrier();
+
+        // Corner 0 finalizes the cell and decides on refinement
+        if (active && corner == 0u) {
+            double min_err = 1e300LF;
+            double max_err = 0.0LF;
+            for (uint k = 0u; k < 4u; k++) {
+                double err = local_err[local_idx + k];
+                cells[cell_idx].corner_err[k] = err;
+                cells[cell_idx].corner_score[k] = local_score[local_idx + k];
+                min_err = min(min_err, err);
+                max_err = max(max_err, err);
+            }
+
+            // Spread in decades (float log is plenty to compare against a threshold)
+            float spread = log2(float(max_err)) - log2(float(max(min_err, 1e-300LF)));
+            bool refine = level < max_level
+                       && (min_err < refine_error
+                           || double(spread) * 0.30102999566LF > refine_gradient);
+
+            uint first_child = NO_CHILDREN;
+            if (refine) {
+                uint slot = atomicAdd(cell_count, 4u);
+                if (slot + 4u <= capacity) {
+                    first_child = slot;
+                    LandscapeCell child;
+                    child.level = level + 1u;
+                    child.first_child = NO_CHILDREN;
+                    for (uint k = 0u; k < 4u; k++) {
+                        child.i = 2u * cells[cell_idx].i + (k & 1u);
+                        child.j = 2u * cells[cell_idx].j + (k >> 1u);
+                        child.corner_err[k] = 0.0LF;
+                        child.corner_score[k] = 0.0LF;
+                        cells[slot + k] = child;
+                    }
+                } else {
+                    atomicAdd(overflow, 1u);
+                    atomicMin(first_overflow, slot);
+                }
+            }
+            cells[cell_idx].first_child = first_child;
+        }
+        barrier();
+    }
+
+    // ========================================================================
+    // LAST WORKGROUP RECORDS WHERE THE NEXT LEVEL ENDS
+    // ========================================================================
+
+    memoryBarrier();
+    barrier();
+
+    if (local_idx == 0u) {
+        local_is_last = atomicAdd(workgroups_done, 1u) == gl_NumWorkGroups.x - 1u;
+    }
+    barrier();
+
+    if (local_is_last && local_idx == 0u) {
+        memoryBarrier();
+        // Children of this level were appended contiguously after it. Every
+        // slot below the first one that did not fit was written.
+        uint count = min(atomicAdd(cell_count, 0u), min(first_overflow, capacity));
+        cell_count = count;
+        level_begin[level + 2u] = count;
+        first_overflow = 0xFFFFFFFFu;
+        workgroups_done = 0u;
+    }
+}
@@ -0,0 +1,40 @@
+// model.glsl.c
+// Layer and Model records shared by the explorer and the solvers.
+// The layout is std430 and mirrored by Model._model_dtype on the host.
+
+#ifndef MODEL_GLSL_C
+#define MODEL_GLSL_C
+
+#include "shader/precision.glsl.c"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+
+struct Layer {
+    BUFF_REAL a;
+    BUFF_REAL b;
+    BUFF_REAL c;
+    BUFF_REAL r;
+    BUFF_REAL density;
+};
+
+struct Model {
+    BUFF_REAL angular_momentum;  // offset 0, 8 bytes
+    uint num_layers;             // offset 8, 4 bytes
+    // implicit 4 bytes padding to align array to 16-byte boundary
+    Layer layers[20];            // offset 16, 800 bytes (20 × 40)
+    
+    BUFF_REAL rel_equipotential_err;  // offset 816, 8 bytes
+    BUFF_REAL total_energy;           // offset 824, 8 bytes
+    BUFF_REAL angular_velocity;       // offset 832, 8 bytes
+    BUFF_REAL moment_of_inertia;      // offset 840, 8 bytes
+    BUFF_REAL potential_energy;       // offset 848, 8 bytes
+    BUFF_REAL kinetic_energy;         // offset 856, 8 bytes
+    BUFF_REAL virial_ratio;           // offset 864, 8 bytes
+    BUFF_REAL padding_sentinel;       // offset 872, 8 bytes
+    BUFF_REAL score;                  // offset 880, 8 bytes
+    // Total size: 888 bytes
+};
+
+#endif
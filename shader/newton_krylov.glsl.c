@@ -0,0 +1,160 @@
+#version 460 core
+#extension GL_ARB_gpu_shader_fp64 : require
+
+#include "shader/precision.glsl.c"
+#include "shader/dual.glsl.c"
+#include "shader/potential_dual.glsl.c"
+
+// Equilibrium residuals and their directional derivatives, one workgroup
+// per work item, for the matrix-free Newton-Krylov solver
+// (newton_krylov.py).
+//
+// Unknowns per layer are (log a, log b); c follows from the fixed volume,
+// so dlog c = -(dlog a + dlog b). Residuals per layer are
+//
+//     F0 = phi_a / phi_c - 1,    F1 = phi_b / phi_c - 1
+//
+// with phi the effective potential at the layer's axis tips, using the
+// same interior/exterior layer pairing as compute_statistics. Evaluating
+// everything with dual numbers seeded by the item's direction gives F and
+// J*v in one pass. There is no per-model layer limit: layers are
+// addressed through layer_offset, and each invocation handles every
+// 256th surface layer.
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+
+struct NKItem {
+    double angular_momentum;    // offset 0
+    double d_angular_momentum;  // offset 8 (direction component along L)
+    uint num_layers;            // offset 16
+    uint layer_offset;          // offset 20 (first layer in nk_layers / nk_out)
+    // Total size: 24 bytes
+};
+
+struct NKLayer {
+    double a;           // offset 0
+    double b;           // offset 8
+    double c;           // offset 16
+    double density;     // offset 24
+    double dlog_a;      // offset 32 (direction)
+    double dlog_b;      // offset 40 (direction)
+    // Total size: 48 bytes
+};
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+layout(std430, binding = 0) buffer NKItems {
+    NKItem nk_items[];
+};
+
+layout(std430, binding = 1) buffer NKLayers {
+    NKLayer nk_layers[];
+};
+
+// Per layer: (F0, F1, (J v)0, (J v)1)
+layout(std430, binding = 2) buffer NKOut {
+    dvec4 nk_out[];
+};
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint num_items;
+
+// ============================================================================
+// Shared memory
+// ============================================================================
+
+shared DUAL local_moi[256];
+
+// ============================================================================
+// Main Compute Shader
+// ============================================================================
+
+DUAL layer_axis(uint layer, uint axis)
+{
+    NKLayer l = nk_layers[layer];
+    if (axis == 0u) {
+        return DUAL(l.a, l.a * l.dlog_a);
+    } else if (axis == 1u) {
+        return DUAL(l.b, l.b * l.dlog_b);
+    }
+    return DUAL(l.c, -l.c * (l.dlog_a + l.dlog_b));
+}
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint item = gl_WorkGroupID.x;
+    uint local_idx = gl_LocalInvocationID.x;
+    
+    if (item >= num_items) {
+        return;
+    }
+    
+    uint num_layers = nk_items[item].num_layers;
+    uint offset = nk_items[item].layer_offset;
+    
+    // ========================================================================
+    // MOMENT OF INERTIA AND ROTATION RATE (workgroup reduction)
+    // ========================================================================
+    
+    DUAL moi = dual_const(R(0.LF));
+    for (uint i = local_idx; i < num_layers; i += gl_WorkGroupSize.x) {
+        DUAL a = layer_axis(offset + i, 0u);
+        DUAL b = layer_axis(offset + i, 1u);
+        DUAL c = layer_axis(offset + i, 2u);
+        moi += nk_layers[offset + i].density 
+             * dual_mul(dual_mul(dual_mul(a, b), c), dual_mul(a, a) + dual_mul(b, b));
+    }
+    local_moi[local_idx] = moi;
+    barrier();
+    
+    for (uint stride = gl_WorkGroupSize.x / 2u; stride > 0u; stride /= 2u) {
+        if (local_idx < stride) {
+            local_moi[local_idx] += local_moi[local_idx + stride];
+        }
+        barrier();
+    }
+    
+    moi = R(4.LF/15.LF) * PI * local_moi[0];
+    DUAL ang_mom = DUAL(nk_items[item].angular_momentum, nk_items[item].d_angular_momentum);
+    DUAL ang_vel = dual_div(ang_mom, moi);
+    DUAL ang_vel2 = dual_mul(ang_vel, ang_vel);
+    
+    // ========================================================================
+    // RESIDUALS AT EACH SURFACE LAYER
+    // ========================================================================
+    
+    for (uint s = local_idx; s < num_layers; s += gl_WorkGroupSize.x) {
+        DUAL tip_a = layer_axis(offset + s, 0u);
+        DUAL tip_b = layer_axis(offset + s, 1u);
+        DUAL tip_c = layer_axis(offset + s, 2u);
+        
+        DUAL pot_a = R(0.5LF) * dual_mul(ang_vel2, dual_mul(tip_a, tip_a));
+        DUAL pot_b = R(0.5LF) * dual_mul(ang_vel2, dual_mul(tip_b, tip_b));
+        DUAL pot_c = dual_const(R(0.LF));
+        
+        for (uint m = 0u; m < num_layers; m++) {
+            DUAL a = layer_axis(offset + m, 0u);
+            DUAL b = layer_axis(offset + m, 1u);
+            DUAL c = layer_axis(offset + m, 2u);
+            double density = nk_layers[offset + m].density;
+            bool inside = s <= m;
+            
+            pot_a += density * potential_axis_dual(0u, a, b, c, tip_a, inside);
+            pot_b += density * potential_axis_dual(1u, a, b, c, tip_b, inside);
+            pot_c += density * potential_axis_dual(2u, a, b, c, tip_c, inside);
+        }
+        
+        DUAL f0 = dual_div(pot_a, pot_c) - dual_const(R(1.LF));
+        DUAL f1 = dual_div(pot_b, pot_c) - dual_const(R(1.LF));
+        
+        nk_out[offset + s] = dvec4(f0.x, f1.x, f0.y, f1.y);
+    }
+}
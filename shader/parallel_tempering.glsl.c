@@ -0,0 +1,308 @@
+#version 460 core
+#extension GL_ARB_gpu_shader_fp64 : require
+
+#include "shader/precision.glsl.c"
+#include "shader/potential.glsl.c"
+#include "shader/random.glsl.c"
+#include "shader/variation.glsl.c"
+#include "shader/model.glsl.c"
+
+// Parallel tempering: one workgroup per replica chain.
+//
+// Each dispatch runs `sweeps_per_exchange` sweeps in every chain. A sweep
+// is one multiple-try Metropolis step (Liu, Liang & Wong 2000) at the
+// chain's temperature T, with weights w = exp(-score / T):
+//
+//   1. All 256 invocations propose y_j from the current state x.
+//   2. One y is selected with probability w(y_j) / sum w(y).
+//   3. The other 255 invocations propose a reference x_j from y; the
+//      selected slot's reference is x itself.
+//   4. y is accepted with probability min(1, sum w(y) / sum w(x_j)).
+//
+// The proposal (perturb_axes, then the whole-model a >= b mirror) is
+// symmetric, so this leaves exp(-score / T) invariant; simply taking the
+// best of 256 proposals and applying the Metropolis rule to it does not.
+// The last workgroup to finish performs one round of replica exchange
+// between neighbouring temperatures (even pairs on even rounds, odd on
+// odd).
+
+#ifndef PT_MAX_REPLICAS
+#define PT_MAX_REPLICAS 64
+#endif
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+// Proposals: 256 per chain
+layout(std430, binding = 1) coherent buffer Proposals {
+    Model variations[];
+};
+
+// Current state of each chain (indexed by temperature slot)
+layout(std430, binding = 2) coherent buffer Replicas {
+    Model replica_models[];
+};
+
+// Best state ever visited in each temperature slot
+layout(std430, binding = 3) buffer ReplicaBests {
+    Model replica_best_models[];
+};
+
+layout(std430, binding = 4) coherent buffer TemperingState {
+    uint workgroups_done;                         // offset 0
+    uint exchange_round;                          // offset 4
+    double replica_temperature[PT_MAX_REPLICAS];  // offset 8; Metropolis temperature (score units)
+    double replica_step[PT_MAX_REPLICAS];         // proposal spread (annealing_temperature units)
+    uint move_accepts[PT_MAX_REPLICAS];           // accepted moves per slot
+    uint swap_attempts[PT_MAX_REPLICAS];          // exchanges tried between slot i and i+1
+    uint swap_accepts[PT_MAX_REPLICAS];           // exchanges accepted between slot i and i+1
+};
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint num_replicas;
+uniform uint sweeps_per_exchange;
+uniform uint seed;
+uniform double error_threshold;
+
+#include "shader/statistics.glsl.c"
+
+// ============================================================================
+// Shared memory
+// ============================================================================
+
+shared double local_weight[256];
+shared double local_reduce[256];
+shared uint local_selected;
+
+// ============================================================================
+// Workgroup reductions (every invocation of the workgroup must call these)
+// ============================================================================
+
+double workgroup_min(double value)
+{
+    uint local_idx = gl_LocalInvocationID.x;
+    local_reduce[local_idx] = value;
+    barrier();
+    for (uint stride = gl_WorkGroupSize.x / 2u; stride > 0u; stride /= 2u) {
+        if (local_idx < stride) {
+            local_reduce[local_idx] = min(local_reduce[local_idx], local_reduce[local_idx + stride]);
+        }
+        barrier();
+    }
+    double result = local_reduce[0];
+    barrier();  // local_reduce is reused by the next call
+    return result;
+}
+
+double workgroup_sum(double value)
+{
+    uint local_idx = gl_LocalInvocationID.x;
+    local_reduce[local_idx] = value;
+    barrier();
+    for (uint stride = gl_WorkGroupSize.x / 2u; stride > 0u; stride /= 2u) {
+        if (local_idx < stride) {
+            local_reduce[local_idx] += local_reduce[local_idx + stride];
+        }
+        barrier();
+    }
+    double result = local_reduce[0];
+    barrier();
+    return result;
+}
+
+// ============================================================================
+// Proposals
+// ============================================================================
+
+// exp(-(score - shift) / T). Shifting by the best score of the set keeps
+// the weights in [exp(-80), 1]; the shift is put back in the acceptance
+// ratio.
+double mtm_weight(double score, double shift, double temperature)
+{
+    return double(exp(float(max(-(score - shift) / temperature, -80.0LF))));
+}
+
+// Mirror variations[idx] onto a >= b on the outer layer (all layers swap
+// together, as in cluster.glsl.c)
+void mirror_variation(uint idx)
+{
+    uint outer = variations[idx].num_layers - 1u;
+    if (variations[idx].layers[outer].b > variations[idx].layers[outer].a) {
+        for (uint i = 0u; i < variations[idx].num_layers; i++) {
+            BUFF_REAL a = variations[idx].layers[i].a;
+            variations[idx].layers[i].a = variations[idx].layers[i].b;
+            variations[idx].layers[i].b = a;
+        }
+    }
+}
+
+// ============================================================================
+// Replica exchange (run by the last workgroup of the dispatch, thread 0)
+// ============================================================================
+
+void exchange_replicas()
+{
+    PCGState rng;
+    initPCG(rng, seed ^ 0x5bd1e995u, exchange_round);
+    
+    for (uint i = exchange_round & 1u; i + 1u < num_replicas; i += 2u) {
+        double beta_lo = 1.0LF / replica_temperature[i];
+        double beta_hi = 1.0LF / replica_temperature[i + 1u];
+        double delta = (beta_lo - beta_hi) 
+                     * (double(replica_models[i].score) - double(replica_models[i + 1u].score));
+        
+        // Accept with probability min(1, exp(delta))
+        bool accept = delta >= 0.0LF 
+                   || double(pcg_float(rng)) < double(exp(float(max(delta, -80.0LF))));
+        
+        swap_attempts[i]++;
+        if (accept) {
+            Model tmp = replica_models[i];
+            replica_models[i] = replica_models[i + 1u];
+            replica_models[i + 1u] = tmp;
+            swap_accepts[i]++;
+        }
+    }
+    
+    exchange_round++;
+}
+
+// ============================================================================
+// Main Compute Shader
+// ============================================================================
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint local_idx = gl_LocalInvocationID.x;
+    uint chain = gl_WorkGroupID.x;
+    uint idx = gl_GlobalInvocationID.x;  // this invocation's proposal slot
+    
+    if (chain >= num_replicas) {
+        return;
+    }
+    
+    // The host passes a fresh seed for every dispatch
+    PCGState rng;
+    initPCG(rng, seed + idx, idx);
+    
+    double temperature = replica_temperature[chain];
+    double step_size = replica_step[chain];
+    
+    uint base = chain * gl_WorkGroupSize.x;
+    
+    for (uint sweep = 0u; sweep < sweeps_per_exchange; sweep++) {
+        
+        // ====================================================================
+        // PROPOSE y_j FROM THE CURRENT STATE x
+        // ====================================================================
+        
+        uint num_layers = replica_models[chain].num_layers;
+        variations[idx].num_layers = num_layers;
+        variations[idx].angular_momentum = replica_models[chain].angular_momentum;
+        
+        for (uint i = 0u; i < num_layers; i++) {
+            BUFF_REAL a = replica_models[chain].layers[i].a;
+            BUFF_REAL b = replica_models[chain].layers[i].b;
+            BUFF_REAL c = replica_models[chain].layers[i].c;
+            
+            perturb_axes(rng, step_size, a, b, c);
+            
+            variations[idx].layers[i].a = a;
+            variations[idx].layers[i].b = b;
+            variations[idx].layers[i].c = c;
+            variations[idx].layers[i].r = replica_models[chain].layers[i].r;
+            variations[idx].layers[i].density = replica_models[chain].layers[i].density;
+        }
+        mirror_variation(idx);
+        compute_statistics(idx);
+        
+        double score_y = double(variations[idx].score);
+        double shift_y = workgroup_min(score_y);
+        local_weight[local_idx] = mtm_weight(score_y, shift_y, temperature);
+        double sum_y = workgroup_sum(local_weight[local_idx]);
+        
+        // ====================================================================
+        // SELECT y WITH PROBABILITY w(y_j) / sum w(y)
+        // ====================================================================
+        
+        if (local_idx == 0u) {
+            double target = pcg_double(rng) * sum_y;
+            uint k = 0u;
+            double cumulative = local_weight[0];
+            while (cumulative <= target && k + 1u < gl_WorkGroupSize.x) {
+                k++;
+                cumulative += local_weight[k];
+            }
+            local_selected = base + k;
+        }
+        memoryBarrierBuffer();
+        barrier();
+        uint selected = local_selected;
+        
+        // ====================================================================
+        // REFERENCE SET: x_j FROM y, AND x ITSELF IN THE SELECTED SLOT
+        // ====================================================================
+        
+        double score_x;
+        if (idx == selected) {
+            score_x = double(replica_models[chain].score);
+        } else {
+            for (uint i = 0u; i < num_layers; i++) {
+                BUFF_REAL a = variations[selected].layers[i].a;
+                BUFF_REAL b = variations[selected].layers[i].b;
+                BUFF_REAL c = variations[selected].layers[i].c;
+                
+                perturb_axes(rng, step_size, a, b, c);
+                
+                variations[idx].layers[i].a = a;
+                variations[idx].layers[i].b = b;
+                variations[idx].layers[i].c = c;
+            }
+            mirror_variation(idx);
+            compute_statistics(idx);
+            score_x = double(variations[idx].score);
+        }
+        
+        double shift_x = workgroup_min(score_x);
+        double sum_x = workgroup_sum(mtm_weight(score_x, shift_x, temperature));
+        
+        // ====================================================================
+        // ACCEPT y WITH PROBABILITY min(1, sum w(y) / sum w(x_j))
+        // ====================================================================
+        
+        if (local_idx == 0u) {
+            double log_ratio = double(log(float(sum_y / sum_x)))
+                             - (shift_y - shift_x) / temperature;
+            bool accept = log_ratio >= 0.0LF
+                       || double(pcg_float(rng)) < double(exp(float(max(log_ratio, -80.0LF))));
+            if (accept) {
+                replica_models[chain] = variations[selected];
+                move_accepts[chain]++;
+                if (variations[selected].score < replica_best_models[chain].score) {
+                    replica_best_models[chain] = variations[selected];
+                }
+            }
+        }
+        memoryBarrierBuffer();
+        barrier();
+    }
+    
+    // ========================================================================
+    // LAST WORKGROUP EXCHANGES NEIGHBOURING REPLICAS
+    // ========================================================================
+    
+    if (local_idx == 0u) {
+        memoryBarrier();
+        bool is_last = atomicAdd(workgroups_done, 1u) == num_replicas - 1u;
+        if (is_last) {
+            memoryBarrier();
+            exchange_replicas();
+            workgroups_done = 0u;
+        }
+    }
+}
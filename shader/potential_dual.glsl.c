@@ -0,0 +1,53 @@
+// potential_dual.glsl.c
+// Dual-number version of the on-axis ellipsoid potentials in
+// potential.glsl.c: value and directional derivative with respect to the
+// semiaxes and the field point together.
+
+#ifndef POTENTIAL_DUAL_GLSL_C
+#define POTENTIAL_DUAL_GLSL_C
+
+#include "shader/precision.glsl.c"
+#include "shader/dual.glsl.c"
+#include "shader/carlson_dual.glsl.c"
+
+// Potential per unit (G * density) of ellipsoid (a, b, c) at distance p
+// along `axis` (0: x, 1: y, 2: z). `inside` selects the interior form
+// (p within the ellipsoid) or the exterior form, whose confocal parameter
+// is lambda = p^2 - (semiaxis along `axis`)^2. Matches
+// potential_interior_* / potential_exterior_* in value.
+DUAL potential_axis_dual(uint axis, DUAL a, DUAL b, DUAL c, DUAL p, bool inside)
+{
+    DUAL a2 = dual_mul(a, a);
+    DUAL b2 = dual_mul(b, b);
+    DUAL c2 = dual_mul(c, c);
+    DUAL p2 = dual_mul(p, p);
+    DUAL abc = dual_mul(dual_mul(a, b), c);
+    
+    DUAL lam = dual_const(R(0.LF));
+    if (!inside) {
+        lam = p2 - ((axis == 0u) ? a2 : (axis == 1u) ? b2 : c2);
+    }
+    
+    DUAL a2_lam = a2 + lam;
+    DUAL b2_lam = b2 + lam;
+    DUAL c2_lam = c2 + lam;
+    
+    // I(lambda) = 2abc R_F(a²+λ, b²+λ, c²+λ)
+    DUAL I_lam = R(2.0LF) * dual_mul(abc, carlson_rf_dual(a2_lam, b2_lam, c2_lam));
+    
+    // A_axis(lambda) = (2/3) abc R_D(., ., axis²+λ)
+    DUAL rd;
+    if (axis == 0u) {
+        rd = carlson_rd_dual(b2_lam, c2_lam, a2_lam);
+    } else if (axis == 1u) {
+        rd = carlson_rd_dual(a2_lam, c2_lam, b2_lam);
+    } else {
+        rd = carlson_rd_dual(a2_lam, b2_lam, c2_lam);
+    }
+    DUAL A_lam = R(2.0LF / 3.0LF) * dual_mul(abc, rd);
+    
+    // Φ = π G ρ [I(λ) - A(λ) p²]
+    return PI * (I_lam - dual_mul(A_lam, p2));
+}
+
+#endif
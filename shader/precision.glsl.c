@@ -26,12 +26,14 @@
     #define CALC_REAL double
     #define CALC_VEC4 dvec4
     #define CALC_VEC3 dvec3
+    #define CALC_VEC2 dvec2
     #define ITER 11
     #define R(x) double(x)
 #elif CALC_PRECISION == float
     #define CALC_REAL float
     #define CALC_VEC4 vec4
     #define CALC_VEC3 vec3
+    #define CALC_VEC2 vec2
     #define ITER 8
     #define R(x) float(x)
 #else
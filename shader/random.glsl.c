@@ -15,6 +15,12 @@ float pcg_float(inout PCGState rng) {
     return float(pcg_hash(rng)) / 4294967296.0;
 }
 
+// Uniform double in [0, 1) from one 32-bit draw. Exact (no rounding), so
+// host code can reproduce it bit for bit.
+double pcg_double(inout PCGState rng) {
+    return double(pcg_hash(rng)) * (1.0LF / 4294967296.0LF);
+}
+
 // Initialize with unique seed per thread
 void initPCG(inout PCGState rng, uint seed, uint sequence) {
     rng.state = 0u;
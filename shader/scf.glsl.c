@@ -0,0 +1,174 @@
+#version 460 core
+#extension GL_ARB_gpu_shader_fp64 : require
+
+#include "shader/precision.glsl.c"
+#include "shader/potential.glsl.c"
+#include "shader/dmath.glsl.c"
+#include "shader/model.glsl.c"
+
+// Self-consistent-field iteration, one invocation per model.
+//
+// Each iteration freezes the current mass distribution and rotation rate,
+// evaluates the effective potential and its radial derivative at the three
+// axis tips of every layer, and moves the tips toward the common value that
+// keeps the layer's volume fixed:
+//
+//     dln p_k = relaxation * (phi* - phi_k) / (p_k * dphi_k/dp)
+//
+// with phi* chosen so that sum_k dln p_k = 0. The rotation rate is then
+// recomputed from the (fixed) angular momentum and the new moment of
+// inertia. The converged model is scored with compute_statistics.
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+// Models to iterate (in place)
+layout(std430, binding = 1) buffer Models {
+    Model variations[];
+};
+
+// Per-model outcome
+layout(std430, binding = 2) buffer SCFStatus {
+    uvec2 scf_iterations_converged[];  // (iterations used, converged flag)
+};
+
+// ============================================================================
+// Uniforms
+// ============================================================================
+
+uniform uint num_models;
+uniform uint max_iterations;
+uniform double relaxation;     // 1.0 = full linearized step
+uniform double tolerance;      // stop when max |dln p| falls below this
+uniform double error_threshold;
+
+#include "shader/statistics.glsl.c"
+
+// ============================================================================
+// Invocation-private working copy of the model
+// ============================================================================
+
+CALC_REAL scf_axes[20][3];
+CALC_REAL scf_density[20];
+
+// Effective potential at distance p along `axis` (0: x, 1: y, 2: z) from the
+// frozen mass distribution, including the centrifugal term.
+CALC_REAL effective_potential(uint axis, CALC_REAL p, uint num_layers, CALC_REAL omega)
+{
+    CALC_REAL phi = (axis == 2u) ? R(0.LF) : R(0.5LF) * omega * omega * p * p;
+    
+    for (uint m = 0u; m < num_layers; m++) {
+        CALC_REAL a = scf_axes[m][0];
+        CALC_REAL b = scf_axes[m][1];
+        CALC_REAL c = scf_axes[m][2];
+        bool inside = p <= scf_axes[m][axis];
+        
+        CALC_REAL pot;
+        if (axis == 0u) {
+            pot = inside ? potential_interior_x(a, b, c, p) : potential_exterior_x(a, b, c, p);
+        } else if (axis == 1u) {
+            pot = inside ? potential_interior_y(a, b, c, p) : potential_exterior_y(a, b, c, p);
+        } else {
+            pot = inside ? potential_interior_z(a, b, c, p) : potential_exterior_z(a, b, c, p);
+        }
+        phi += scf_density[m] * pot;
+    }
+    
+    return phi;
+}
+
+// ============================================================================
+// Main Compute Shader
+// ============================================================================
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint idx = gl_GlobalInvocationID.x;
+    
+    if (idx >= num_models) {
+        return;
+    }
+    
+    uint num_layers = variations[idx].num_layers;
+    CALC_REAL angular_momentum = variations[idx].angular_momentum;
+    
+    for (uint i = 0u; i < num_layers; i++) {
+        scf_axes[i][0] = variations[idx].layers[i].a;
+        scf_axes[i][1] = variations[idx].layers[i].b;
+        scf_axes[i][2] = variations[idx].layers[i].c;
+        scf_density[i] = variations[idx].layers[i].density;
+    }
+    
+    uint iteration = 0u;
+    bool converged = false;
+    
+    CALC_REAL dlog[20][3];
+    
+    while (iteration < max_iterations && !converged) {
+        iteration++;
+        
+        // Rotation rate implied by the current shape
+        CALC_REAL moi = R(0.LF);
+        for (uint i = 0u; i < num_layers; i++) {
+            moi += scf_density[i] * scf_axes[i][0] * scf_axes[i][1] * scf_axes[i][2]
+                 * (scf_axes[i][0] * scf_axes[i][0] + scf_axes[i][1] * scf_axes[i][1]);
+        }
+        moi *= R(4.LF/15.LF) * PI;
+        CALC_REAL omega = angular_momentum / moi;
+        
+        // ====================================================================
+        // LINEARIZED, VOLUME-PRESERVING MOVE OF EACH LAYER'S TIPS
+        // ====================================================================
+        
+        CALC_REAL max_change = R(0.LF);
+        
+        for (uint s = 0u; s < num_layers; s++) {
+            CALC_REAL phi[3];
+            CALC_REAL slope[3];   // p * dphi/dp
+            
+            for (uint k = 0u; k < 3u; k++) {
+                CALC_REAL p = scf_axes[s][k];
+                CALC_REAL h = R(1e-4LF) * p;
+                phi[k] = effective_potential(k, p, num_layers, omega);
+                slope[k] = p * (effective_potential(k, p + h, num_layers, omega) 
+                              - effective_potential(k, p - h, num_layers, omega)) / (R(2.LF) * h);
+            }
+            
+            // phi* such that the log-steps sum to zero
+            CALC_REAL num = R(0.LF);
+            CALC_REAL den = R(0.LF);
+            for (uint k = 0u; k < 3u; k++) {
+                num += phi[k] / slope[k];
+                den += R(1.LF) / slope[k];
+            }
+            CALC_REAL phi_star = num / den;
+            
+            for (uint k = 0u; k < 3u; k++) {
+                dlog[s][k] = relaxation * (phi_star - phi[k]) / slope[k];
+                max_change = max(max_change, abs(dlog[s][k]));
+            }
+        }
+        
+        // Apply after all layers are evaluated (Jacobi-style update)
+        for (uint s = 0u; s < num_layers; s++) {
+            CALC_REAL volume = scf_axes[s][0] * scf_axes[s][1] * scf_axes[s][2];
+            scf_axes[s][0] *= R(dexp(dlog[s][0]));
+            scf_axes[s][1] *= R(dexp(dlog[s][1]));
+            scf_axes[s][2] = volume / (scf_axes[s][0] * scf_axes[s][1]);
+        }
+        
+        converged = max_change < tolerance;
+    }
+    
+    for (uint i = 0u; i < num_layers; i++) {
+        variations[idx].layers[i].a = BR(scf_axes[i][0]);
+        variations[idx].layers[i].b = BR(scf_axes[i][1]);
+        variations[idx].layers[i].c = BR(scf_axes[i][2]);
+    }
+    
+    scf_iterations_converged[idx] = uvec2(iteration, converged ? 1u : 0u);
+    
+    compute_statistics(idx);
+}
@@ -0,0 +1,172 @@
+// statistics.glsl.c
+// Scoring of a candidate model in place.
+//
+// The including shader must declare, before including this file:
+//     buffer ... { Model variations[]; };   // models to score
+//     uniform double error_threshold;       // 0: score by error alone
+
+#ifndef STATISTICS_GLSL_C
+#define STATISTICS_GLSL_C
+
+#include "shader/precision.glsl.c"
+#include "shader/potential.glsl.c"
+#include "shader/model.glsl.c"
+
+#ifdef ADAPTIVE_TEMPERATURE
+// Per-layer equipotential error of the variation last passed to
+// compute_statistics (invocation-private)
+CALC_REAL stat_layer_err[20];
+#endif
+
+// Layer count of variations[idx]; a compile-time constant when the program
+// is specialized with FIXED_NUM_LAYERS, so the layer loops unroll
+#ifdef FIXED_NUM_LAYERS
+#define STAT_NUM_LAYERS(idx) (FIXED_NUM_LAYERS)
+#else
+#define STAT_NUM_LAYERS(idx) variations[idx].num_layers
+#endif
+
+// ============================================================================
+// Statistics computation
+// ============================================================================
+
+void compute_statistics(uint idx)
+{
+    bool valid = true;
+    
+    // Initialize error accumulator to zero
+    variations[idx].rel_equipotential_err = BR(0.0LF);
+    
+    // compute Moment of Inertia
+    CALC_REAL moi = R(0.LF);    
+    for (uint layer_idx = 0; layer_idx < STAT_NUM_LAYERS(idx); layer_idx++)
+    {
+        moi += variations[idx].layers[layer_idx].density 
+                * variations[idx].layers[layer_idx].a 
+                * variations[idx].layers[layer_idx].b 
+                * variations[idx].layers[layer_idx].c 
+                * (variations[idx].layers[layer_idx].a * variations[idx].layers[layer_idx].a 
+                    + variations[idx].layers[layer_idx].b * variations[idx].layers[layer_idx].b);
+    }
+    moi *= R(4.LF/15.LF) * PI;
+    
+    // Store moment of inertia
+    variations[idx].moment_of_inertia = BR(moi);
+    
+    // compute Angular Velocity
+    CALC_REAL ang_vel = variations[idx].angular_momentum / moi;
+    
+    // Store angular velocity
+    variations[idx].angular_velocity = BR(ang_vel);
+    
+    // Iterate through the layers to get the points we want to calculate the potential at
+    for (uint surf_layer_idx = 0; surf_layer_idx < STAT_NUM_LAYERS(idx); surf_layer_idx++)
+    {
+        // accumulate the effective potential at (a,0,0), (0,b,0), and (0,0,c)
+        // start with the centrifugal contribution before iterating through layers
+        // (Note: Chandrasekhar convention is that these are positive. I'd argue with
+        // him, but sadly, he has passed on.)
+        CALC_REAL pot_a = R(0.5LF) 
+                        * ang_vel * ang_vel 
+                        * variations[idx].layers[surf_layer_idx].a * variations[idx].layers[surf_layer_idx].a;
+        CALC_REAL pot_b = R(0.5LF) 
+                        * ang_vel * ang_vel 
+                        * variations[idx].layers[surf_layer_idx].b * variations[idx].layers[surf_layer_idx].b;
+        CALC_REAL pot_c = 0.LF;
+         
+        // Iterate through the layers to get the ellipsoid creating a potential at the points
+        for (uint mass_layer_idx = 0; mass_layer_idx < STAT_NUM_LAYERS(idx); mass_layer_idx++)
+        {
+            if (surf_layer_idx <= mass_layer_idx)
+            {
+                // The surface points will be inside or on the ellipsoid
+                
+                pot_a += variations[idx].layers[mass_layer_idx].density * 
+                                potential_interior_x(
+                                        variations[idx].layers[mass_layer_idx].a, 
+                                        variations[idx].layers[mass_layer_idx].b, 
+                                        variations[idx].layers[mass_layer_idx].c, 
+                                        variations[idx].layers[surf_layer_idx].a);
+                pot_b += variations[idx].layers[mass_layer_idx].density *
+                                potential_interior_y(
+                                        variations[idx].layers[mass_layer_idx].a, 
+                                        variations[idx].layers[mass_layer_idx].b, 
+                                        variations[idx].layers[mass_layer_idx].c, 
+                                        variations[idx].layers[surf_layer_idx].b);
+                pot_c += variations[idx].layers[mass_layer_idx].density * 
+                                potential_interior_z(
+                                        variations[idx].layers[mass_layer_idx].a, 
+                                        variations[idx].layers[mass_layer_idx].b, 
+                                        variations[idx].layers[mass_layer_idx].c, 
+                                        variations[idx].layers[surf_layer_idx].c);
+                
+            }
+            else
+            {
+                // The surface points will be outside the ellipsoid
+                
+                // check for bad overlap
+                valid = valid 
+                        && (variations[idx].layers[surf_layer_idx].a > variations[idx].layers[mass_layer_idx].a) 
+                        && (variations[idx].layers[surf_layer_idx].b > variations[idx].layers[mass_layer_idx].b) 
+                        && (variations[idx].layers[surf_layer_idx].c > variations[idx].layers[mass_layer_idx].c);
+                
+                pot_a += variations[idx].layers[mass_layer_idx].density * 
+                                potential_exterior_x(
+                                        variations[idx].layers[mass_layer_idx].a, 
+                                        variations[idx].layers[mass_layer_idx].b, 
+                                        variations[idx].layers[mass_layer_idx].c, 
+                                        variations[idx].layers[surf_layer_idx].a);
+                pot_b += variations[idx].layers[mass_layer_idx].density *
+                                potential_exterior_y(
+                                        variations[idx].layers[mass_layer_idx].a, 
+                                        variations[idx].layers[mass_layer_idx].b, 
+                                        variations[idx].layers[mass_layer_idx].c, 
+                                        variations[idx].layers[surf_layer_idx].b);
+                pot_c += variations[idx].layers[mass_layer_idx].density * 
+                                potential_exterior_z(
+                                        variations[idx].layers[mass_layer_idx].a, 
+                                        variations[idx].layers[mass_layer_idx].b, 
+                                        variations[idx].layers[mass_layer_idx].c, 
+                                        variations[idx].layers[surf_layer_idx].c);
+            }
+        }
+        
+        CALC_REAL max_pot = max(pot_a, max(pot_b, pot_c));
+        CALC_REAL min_pot = min(pot_a, min(pot_b, pot_c));
+      
+        variations[idx].rel_equipotential_err += (max_pot - min_pot) / min_pot;  
+#ifdef ADAPTIVE_TEMPERATURE
+        stat_layer_err[surf_layer_idx] = (max_pot - min_pot) / min_pot;
+#endif
+    }
+    
+    variations[idx].rel_equipotential_err = valid ? variations[idx].rel_equipotential_err / STAT_NUM_LAYERS(idx) : BR(1e30LF);
+    
+    // Stub out energy fields for now
+    variations[idx].potential_energy = BR(0.0LF);
+    variations[idx].kinetic_energy = BR(0.5LF) * BR(moi) * BR(ang_vel) * BR(ang_vel);
+    variations[idx].total_energy = variations[idx].potential_energy + variations[idx].kinetic_energy;
+    variations[idx].virial_ratio = BR(0.0LF);  // Will be 2*KE / |PE| once PE is implemented
+    
+    // Set sentinel to pi
+    variations[idx].padding_sentinel = BR(3.14159265358979323846LF);
+    
+    // Compute score based on error_threshold
+    if (error_threshold == 0.0) {
+        // Score by error alone
+        variations[idx].score = variations[idx].rel_equipotential_err;
+    } else {
+        // Score by KE if error is below threshold, otherwise penalize heavily
+        if (variations[idx].rel_equipotential_err < BR(error_threshold)) {
+            variations[idx].score = variations[idx].kinetic_energy;
+        } else {
+            variations[idx].score = BR(1e30LF);
+        }
+    }
+    
+    return;
+}
+
+
+#endif
@@ -0,0 +1,47 @@
+// variation.glsl.c
+// Random perturbation of one layer's semiaxes, shared by every sampler
+// (explorer, parallel tempering, ...) so they draw from the same proposal
+// distribution.
+
+#ifndef VARIATION_GLSL_C
+#define VARIATION_GLSL_C
+
+#include "shader/precision.glsl.c"
+#include "shader/random.glsl.c"
+#include "shader/dmath.glsl.c"
+
+// Log-uniform, volume-preserving perturbation of (a, b, c). `temperature`
+// scales the spread of the log2 multipliers. Consumes three draws from rng.
+//
+// The step is symmetric: a multiplier and its reciprocal are equally
+// likely. Callers fold the perturbed model onto a >= b on the outer layer
+// by swapping a and b in every layer together (a quarter turn about the
+// rotation axis, so the score is unchanged). Swapping one layer alone is
+// not a symmetry of a multi-layer model.
+//
+// Everything is double, add/multiply only and `precise`, so a variant can
+// be regenerated bit for bit on the host from (template, seed, index,
+// temperature); host_variation.py mirrors this function.
+void perturb_axes(inout PCGState rng, double temperature,
+                  inout BUFF_REAL a, inout BUFF_REAL b, inout BUFF_REAL c)
+{
+    const double LN2 = 0.6931471805599453LF;
+    
+    precise double rand1 = 1.5LF * pcg_double(rng);
+    precise double rand2 = 1.5LF * pcg_double(rng);
+    precise double rand3 = 1.5LF * pcg_double(rng);
+    precise double avg = (rand1 + rand2 + rand3) * 0.3333333333333333LF;
+    
+    // 2^x = e^(x ln2)
+    precise double e1 = (rand1 - avg) * temperature * LN2;
+    precise double e2 = (rand2 - avg) * temperature * LN2;
+    BUFF_REAL mul1 = BR(dexp(e1));
+    BUFF_REAL mul2 = BR(dexp(e2));
+    BUFF_REAL mul3 = BR(dexp(-(e1 + e2)));  // Preserve volume
+
+    a = a * mul1;
+    b = b * mul2;
+    c = c * mul3;
+}
+
+#endif
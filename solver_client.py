@@ -0,0 +1,70 @@
+# -*- coding: utf-8 -*-
+"""
+Client for solver_daemon.py. Imports neither Qt nor GL, so it starts in
+milliseconds.
+
+    python solver_client.py model.json [more.json ...] [--socket PATH]
+        [--variants N] [--temperature T] [--top-k K]
+
+Every model is sent on one connection before any reply is read; replies
+are printed as they arrive.
+"""
+
+import json
+import socket
+
+DEFAULT_SOCKET = "/tmp/tuyok-solver.sock"
+
+
+def solve(models, path=DEFAULT_SOCKET, **params):
+    """
+    Send models to the daemon and yield replies in completion order.
+
+    Args:
+        models: List of model dicts
+        path: Daemon socket
+        params: num_variants, temperature, top_k, error_threshold, seed
+
+    Yields:
+        Reply dicts ('id' is the model's index in `models`)
+    """
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(path)
+        for i, model in enumerate(models):
+            request = dict(params, id=i, model=model)
+            sock.sendall((json.dumps(request) + "\n").encode())
+        sock.shutdown(socket.SHUT_WR)
+
+        with sock.makefile('r') as replies:
+            for line in replies:
+                yield json.loads(line)
+
+
+if __name__ == '__main__':
+    import sys
+
+    args = sys.argv[1:]
+    options = {'--socket': ('path', str), '--variants': ('num_variants', int),
+               '--temperature': ('temperature', float), '--top-k': ('top_k', int)}
+    params = {'path': DEFAULT_SOCKET}
+    filenames = []
+    while args:
+        arg = args.pop(0)
+        if arg in options:
+            name, kind = options[arg]
+            params[name] = kind(args.pop(0))
+        else:
+            filenames.append(arg)
+
+    models = []
+    for filename in filenames:
+        with open(filename, 'r') as fp:
+            models.append(json.load(fp))
+
+    for reply in solve(models, **params):
+        name = filenames[reply['id']] if reply.get('id') is not None else '?'
+        if 'error' in reply:
+            print(f"{name}: error: {reply['error']}")
+        else:
+            print(f"{name}: rel_equipotential_err {reply['best']['rel_equipotential_err']:.3e} "
+                  f"({reply['latency']:.3f} seconds)")
@@ -0,0 +1,183 @@
+# -*- coding: utf-8 -*-
+"""
+Long-lived solver service on a Unix socket.
+
+A Solver.py run spends most of its time on imports, Qt/GL context setup,
+shader compilation and buffer allocation before it does any work. The
+daemon pays those costs once. It keeps the context on a
+GLSubmissionThread, keeps compiled program variants in the harness cache,
+and keeps buffers allocated between requests of the same size.
+
+Protocol: newline-delimited JSON both ways. A client may pipeline any
+number of requests on one connection:
+
+    {"id": 7, "model": {...}, "num_variants": 1000000, "temperature": 1.0,
+     "top_k": 10, "error_threshold": 0.0, "seed": null}
+
+error_threshold must be a number ("auto" is not supported). Results
+come back in completion order, each with the wall time from receipt to
+reply:
+
+    {"id": 7, "best": {...}, "top_models": [...], "latency": 0.184}
+    {"id": 8, "error": "..."}
+
+Requests from all clients share the GL thread's queue, so unseeded
+requests with the same parameters are batched into one dispatch.
+solver_client.py is a client that does not import GL.
+
+    python solver_daemon.py [socket path] [--warm-layers 1,2,5]
+"""
+
+import json
+import os
+import queue
+import socketserver
+import threading
+import time
+from concurrent.futures import Future
+
+from Model import Model
+from gl_thread import GLSubmissionThread
+
+
+DEFAULT_SOCKET = "/tmp/tuyok-solver.sock"
+
+_DEFAULTS = {
+    'num_variants': 1000000,
+    'temperature': 1.0,
+    'top_k': 1,
+    'error_threshold': 0.0,
+    'seed': None,
+}
+
+
+class _Closed:
+    """End of a connection's input, after num_requests requests."""
+
+    def __init__(self, num_requests):
+        self.num_requests = num_requests
+
+
+class _Handler(socketserver.StreamRequestHandler):
+
+    def handle(self):
+        # Done callbacks run on the GL thread, so they only queue the
+        # finished future; this connection's writer thread formats and
+        # sends replies, and a slow client never stalls dispatch
+        replies = queue.Queue()
+        writer = threading.Thread(target=self._write_replies, args=(replies,),
+                                  name="solver-reply", daemon=True)
+        writer.start()
+
+        num_requests = 0
+        try:
+            for line in self.rfile:
+                if not line.strip():
+                    continue
+                received = time.time()
+                num_requests += 1  # each counted request queues exactly one reply
+                request_id = None
+                try:
+                    request = json.loads(line)
+                    if not isinstance(request, dict):
+                        raise TypeError("request must be a JSON object")
+                    request_id = request.get('id')
+                    params = {k: request.get(k, v) for k, v in _DEFAULTS.items()}
+                    if isinstance(params['error_threshold'], str):
+                        # "auto" needs a per-model histogram; batches have none
+                        raise ValueError("error_threshold must be a number")
+                    model = Model(request['model'])
+                except (ValueError, KeyError, TypeError, AttributeError) as e:
+                    future = Future()
+                    future.set_exception(ValueError(f"bad request: {e}"))
+                    replies.put((request_id, 0.0, future))
+                    continue
+
+                future = self.server.gl.explore(model, params['num_variants'],
+                                                params['temperature'],
+                                                top_k=params['top_k'],
+                                                error_threshold=params['error_threshold'],
+                                                seed=params['seed'])
+                future.add_done_callback(
+                    lambda future, request_id=request_id, received=received:
+                        replies.put((request_id, time.time() - received, future)))
+        finally:
+            # Input closed: return (and let finish() close the socket) only
+            # once every reply has been written
+            replies.put(_Closed(num_requests))
+            writer.join()
+
+    def _write_replies(self, replies):
+        num_written, num_requests = 0, None
+        connected = True
+        while num_requests is None or num_written < num_requests:
+            item = replies.get()
+            if isinstance(item, _Closed):
+                num_requests = item.num_requests
+                continue
+
+            request_id, latency, future = item
+            num_written += 1
+            try:
+                best, top_models = future.result()
+                message = {'id': request_id, 'best': best, 'top_models': top_models,
+                           'latency': latency}
+                print(f"request {request_id}: {latency:.3f} seconds")
+            except Exception as e:
+                message = {'id': request_id, 'error': str(e), 'latency': latency}
+
+            if connected:
+                try:
+                    self.wfile.write((json.dumps(message) + "\n").encode())
+                    self.wfile.flush()
+                except OSError:
+                    connected = False  # client went away; keep counting
+
+
+class SolverDaemon(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+
+    daemon_threads = True
+
+    def __init__(self, path=DEFAULT_SOCKET, warm_layers=(1,)):
+        if os.path.exists(path):
+            os.unlink(path)
+        super().__init__(path, _Handler)
+        self.path = path
+        self.gl = GLSubmissionThread().start()
+        self._warm_up(warm_layers)
+
+    def _warm_up(self, warm_layers):
+        """Compile the explorer for these layer counts before serving."""
+        time_start = time.time()
+        for num_layers in warm_layers:
+            model = Model({'angular_momentum': 1.0,
+                           'layers': [{'r': (i + 1) / num_layers, 'density': 1.0}
+                                      for i in range(num_layers)]})
+            self.gl.explore(model, 256, 0.1, seed=0).result()
+            self.gl.submit(Model.explore_batch, [model, model], 256, 0.1).result()
+        print(f"Warm-up ({list(warm_layers)} layers): {(time.time() - time_start):.3f} seconds")
+
+    def server_close(self):
+        super().server_close()
+        self.gl.stop()
+        if os.path.exists(self.path):
+            os.unlink(self.path)
+
+
+if __name__ == '__main__':
+    import sys
+
+    args = sys.argv[1:]
+    warm_layers = (1,)
+    if '--warm-layers' in args:
+        i = args.index('--warm-layers')
+        warm_layers = tuple(int(n) for n in args[i + 1].split(','))
+        del args[i:i + 2]
+    path = args[0] if args else DEFAULT_SOCKET
+
+    with SolverDaemon(path, warm_layers) as daemon:
+        print(f"Serving on {path}")
+        try:
+            daemon.serve_forever()
+        except KeyboardInterrupt:
+            pass
@@ -0,0 +1,134 @@
+# -*- coding: utf-8 -*-
+"""
+Check the host-side mirror of the explorer's variation code in
+host_variation.py: PCG against a scalar reference, dexp against np.exp,
+regenerated variants for determinism and the proposal's invariants, and
+the numpy compute_statistics on exact Maclaurin/Jacobi equilibria.
+"""
+
+import numpy as np
+
+import host_variation
+import seeding
+from Model import Model
+
+
+def pcg_reference(seed, sequence, count):
+    """Scalar PCG exactly as written in shader/random.glsl.c."""
+    mask = 0xFFFFFFFF
+    state, inc = 0, ((sequence << 1) | 1) & mask
+
+    def step():
+        nonlocal state
+        old = state
+        state = (old * 747796405 + inc) & mask
+        word = (((old >> ((old >> 28) + 4)) ^ old) * 277803737) & mask
+        return (word >> 22) ^ word
+
+    step()
+    state = (state + seed) & mask
+    step()
+    return [step() for _ in range(count)]
+
+
+def test_host_variation():
+    all_passed = True
+
+    print("PCG vs scalar reference:")
+    seed = 0xDEADBEEF
+    indices = np.array([0, 1, 2, 255, 65535, 1 << 20, 0xFFFFFFFF], dtype=np.uint32)
+    state, inc = host_variation.init_pcg(np.uint32(seed) + indices, indices)
+    draws = []
+    for _ in range(5):
+        state, value = host_variation.pcg_hash(state, inc)
+        draws.append(value)
+    draws = np.array(draws).T
+    passed = all(list(draws[k]) == pcg_reference((seed + int(i)) & 0xFFFFFFFF, int(i), 5)
+                 for k, i in enumerate(indices))
+    all_passed &= passed
+    print(f"  {len(indices)} streams x 5 draws  {'PASS' if passed else 'FAIL'}")
+
+    print("dexp vs np.exp:")
+    x = np.linspace(-30.0, 30.0, 100001)
+    err = np.max(np.abs(host_variation.dexp(x) / np.exp(x) - 1))
+    passed = err < 4e-16
+    all_passed &= passed
+    print(f"  max rel err {err:.2e}  {'PASS' if passed else 'FAIL'}")
+
+    model = Model({
+        'angular_momentum': 1.5,
+        'layers': [
+            {'abc': [0.66, 0.6, 0.55], 'density': 2.0},
+            {'abc': [1.1, 1.0, 0.9], 'density': 1.0},
+        ]
+    })
+
+    print("Regenerated variants:")
+    indices = np.arange(4096)
+    first = host_variation.regenerate_records(model, 1234, indices, 0.2)
+    second = host_variation.regenerate_records(model, 1234, indices[::-1], 0.2)[::-1]
+    same = first.tobytes() == second.tobytes()
+    layers = first['layers'][:, :2]
+    volumes = layers['a'] * layers['b'] * layers['c']
+    expected = np.array([np.prod(layer['abc']) for layer in model['layers']])
+    volume_err = np.max(np.abs(volumes / expected - 1))
+    ordered = np.all(layers['a'][:, -1] >= layers['b'][:, -1])
+    moved = np.all(layers['a'] != np.array([0.66, 1.1]))
+    passed = same and volume_err < 1e-14 and ordered and moved
+    all_passed &= passed
+    print(f"  order independent {same}, max volume err {volume_err:.1e}, "
+          f"outer a >= b {ordered}  {'PASS' if passed else 'FAIL'}")
+
+    frozen = host_variation.regenerate_records(model, 1234, indices[:8], 0.0)
+    passed = np.all(frozen['layers'][:, 0]['a'] == 0.66) and np.all(frozen['layers'][:, 1]['c'] == 0.9)
+    all_passed &= passed
+    print(f"  zero temperature returns the template  {'PASS' if passed else 'FAIL'}")
+
+    # Winners come back best first, each compared with its own GPU score
+    pairs = np.zeros(len(indices), dtype=Model._score_index_dtype)
+    pairs['score'] = first['score']
+    pairs['idx'] = indices
+    shuffled = pairs[np.random.default_rng(0).permutation(len(pairs))]
+    winners, mismatch = host_variation.regenerate_winners(model, shuffled, 16, 1234, 0.2)
+    expected = np.sort(first['score'])[:16]
+    passed = mismatch == 0.0 and np.array_equal(winners['score'], expected) and expected[0] < 1e30
+    all_passed &= passed
+    print(f"  winners of shuffled pairs: mismatch {mismatch:.1e}  {'PASS' if passed else 'FAIL'}")
+
+    print("compute_statistics on exact equilibria:")
+    L = np.array([0.1, 1.0, 2.0, 3.0, 5.0])
+    a, b, c, _ = seeding.equilibrium_shapes(L)
+    records = np.zeros(len(L), dtype=Model._model_dtype)
+    records['angular_momentum'] = L
+    records['num_layers'] = 1
+    records['layers'][:, 0]['a'] = a
+    records['layers'][:, 0]['b'] = b
+    records['layers'][:, 0]['c'] = c
+    records['layers'][:, 0]['density'] = 1.0
+    host_variation.compute_statistics(records)
+    worst = records['rel_equipotential_err'].max()
+    passed = worst < 1e-12 and np.all(records['score'] == records['rel_equipotential_err'])
+    all_passed &= passed
+    print(f"  {len(L)} shapes: max rel_equipotential_err {worst:.2e}  "
+          f"{'PASS' if passed else 'FAIL'}")
+
+    # Overlapping layers are invalid
+    records = host_variation.regenerate_records(model, 1, [0], 0.0)
+    valid = records['rel_equipotential_err'][0] < 1e30
+    records['layers'][0, 0]['a'] = 2.0
+    host_variation.compute_statistics(records)
+    passed = valid and records['rel_equipotential_err'][0] == 1e30
+    all_passed &= passed
+    print(f"  overlapping layers penalized  {'PASS' if passed else 'FAIL'}")
+
+    print("\n" + "=" * 70)
+    if all_passed:
+        print("ALL TESTS PASSED")
+    else:
+        print("SOME TESTS FAILED")
+    print("=" * 70)
+    return all_passed
+
+
+if __name__ == '__main__':
+    test_host_variation()
@@ -0,0 +1,82 @@
+# -*- coding: utf-8 -*-
+"""
+Check the analytic warm starts in seeding.py against the brentq Jacobi
+solution in generate_jacobi_test_case.py, and check that seeded shapes
+satisfy the equipotential conditions exactly.
+"""
+
+import numpy as np
+from scipy.special import elliprf
+
+import seeding
+from generate_jacobi_test_case import generate_test_case
+from Model import Model
+
+
+def tip_residuals(a, b, c, omega2):
+    """(phi_a/phi_c - 1, phi_b/phi_c - 1) for a homogeneous ellipsoid."""
+    I = 2 * a * b * c * elliprf(a * a, b * b, c * c)
+    A1, A2, A3 = seeding._index_coefficients(a, b, c)
+    pot_a = np.pi * (I - A1 * a * a) + 0.5 * omega2 * a * a
+    pot_b = np.pi * (I - A2 * b * b) + 0.5 * omega2 * b * b
+    pot_c = np.pi * (I - A3 * c * c)
+    return pot_a / pot_c - 1, pot_b / pot_c - 1
+
+
+def test_seeding():
+    all_passed = True
+
+    # Jacobi cases from the brentq generator
+    print("Jacobi sequence vs generate_jacobi_test_case:")
+    for a in (1.25, 1.3, 1.6, 2.5):
+        config = generate_test_case(a)
+        expected = np.array(config['layers'][0]['abc'])
+        sa, sb, sc, _ = seeding.equilibrium_shapes([config['angular_momentum']])
+        got = np.array([sa[0], sb[0], sc[0]])
+        err = np.max(np.abs(got - expected) / expected)
+        passed = err < 1e-10
+        all_passed &= passed
+        print(f"  a={a:5.2f}  L={config['angular_momentum']:.6f}  "
+              f"max rel err {err:.2e}  {'PASS' if passed else 'FAIL'}")
+
+    # Both branches, many L at once
+    print("Equipotential residuals:")
+    L = np.concatenate([np.linspace(0.05, 2.5, 50), np.linspace(2.7, 20.0, 50)])
+    a, b, c, omega2 = seeding.equilibrium_shapes(L)
+    res_a, res_b = tip_residuals(a, b, c, omega2)
+    worst = max(np.abs(res_a).max(), np.abs(res_b).max())
+    volume = np.abs(a * b * c - 1).max()
+    passed = worst < 1e-12 and volume < 1e-12 and np.all(np.diff(L) > 0)
+    all_passed &= passed
+    print(f"  {len(L)} shapes: max residual {worst:.2e}, max volume error {volume:.2e}  "
+          f"{'PASS' if passed else 'FAIL'}")
+
+    # Layered model: ratios shared, volumes kept
+    print("Layered template:")
+    model = Model({
+        'angular_momentum': 1.5,
+        'layers': [
+            {'r': 0.6, 'density': 2.0},
+            {'r': 1.0, 'density': 1.0},
+        ]
+    })
+    seeded = seeding.seed_model(model)
+    ratios = [np.array(layer['abc']) / layer['abc'][0] for layer in seeded['layers']]
+    volumes = [np.prod(layer['abc']) for layer in seeded['layers']]
+    passed = (np.allclose(ratios[0], ratios[1], rtol=1e-14)
+              and np.allclose(volumes, [0.216, 1.0], rtol=1e-12)
+              and seeded['angular_momentum'] == model['angular_momentum'])
+    all_passed &= passed
+    print(f"  ratios {ratios[0]}, volumes {volumes}  {'PASS' if passed else 'FAIL'}")
+
+    print("\n" + "=" * 70)
+    if all_passed:
+        print("ALL TESTS PASSED")
+    else:
+        print("SOME TESTS FAILED")
+    print("=" * 70)
+    return all_passed
+
+
+if __name__ == '__main__':
+    test_seeding()
@@ -0,0 +1,89 @@
+# -*- coding: utf-8 -*-
+"""
+Bounded top-k of structured records, shared by many producers.
+
+Chunked GPU runs, CPU explorer threads and worker processes each produce
+partial result arrays; TopKCollector merges them without ever sorting the
+union. Records go in as whole arrays (Model records, or SCORE_INDEX
+(score, idx) pairs, or anything with a score field):
+
+    collector = TopKCollector(k)
+    collector.offer(records)          # from any thread
+    best = collector.records()        # sorted, best first
+
+The fast path takes no lock: the current k-th score is read as-is and
+everything not strictly better is dropped, which for a converging search
+is nearly every record. A stale threshold only lets a few extra records
+through to the locked merge, which re-selects the top k with a partial
+sort. The survivors of a batch are cut to k before the lock is taken, so
+the critical section is O(k).
+
+Collectors pickle (without their lock), so worker processes can return
+theirs and the parent merges them with merge().
+"""
+
+import threading
+
+import numpy as np
+
+from Model import Model
+
+
+def _top(records, k, key):
+    """The k lowest records by `key`, sorted."""
+    if len(records) > k:
+        records = records[np.argpartition(records[key], k - 1)[:k]]
+    return records[np.argsort(records[key], kind='stable')]
+
+
+class TopKCollector:
+
+    def __init__(self, k, dtype=Model._model_dtype, key='score'):
+        self.k = k
+        self.key = key
+        self._best = np.empty(0, dtype=dtype)
+        self._threshold = np.inf
+        self._lock = threading.Lock()
+
+    @property
+    def threshold(self):
+        """Score a record must beat to enter (inf until k are held)."""
+        return self._threshold
+
+    def offer(self, records):
+        """
+        Offer an array of records. Returns how many got past the
+        threshold check (an upper bound on how many were kept).
+        """
+        records = np.asarray(records)
+        candidates = records[records[self.key] < self._threshold]
+        if len(candidates) == 0:
+            return 0
+        candidates = _top(candidates, self.k, self.key)
+
+        with self._lock:
+            self._best = _top(np.concatenate((self._best, candidates)), self.k, self.key)
+            if len(self._best) == self.k:
+                self._threshold = float(self._best[self.key][-1])
+        return len(candidates)
+
+    def merge(self, other):
+        """Fold another collector's records into this one."""
+        return self.offer(other.records())
+
+    def records(self):
+        """Copy of the current top k, best first."""
+        with self._lock:
+            return self._best.copy()
+
+    def __len__(self):
+        return len(self._best)
+
+    def __getstate__(self):
+        state = self.__dict__.copy()
+        del state['_lock']
+        return state
+
+    def __setstate__(self, state):
+        self.__dict__.update(state)
+        self._lock = threading.Lock()